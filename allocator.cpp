@@ -0,0 +1,514 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <iostream>
+
+namespace {
+
+VkDeviceSize alignOffset(VkDeviceSize offset, VkDeviceSize alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// whether the last byte of one resource and the first byte of the next land on the same granularity page
+bool onSamePage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond, VkDeviceSize granularity) {
+    return (endOfFirst - 1) / granularity == startOfSecond / granularity;
+}
+
+}
+
+// a run of bytes in a general block, either free or holding one resource
+struct Range {
+    VkDeviceSize size;
+    bool free;
+    ResourceTiling tiling;
+};
+
+struct MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void * mapped;
+    uint32_t memoryType;
+    AllocationStrategy strategy;
+    bool dedicated;
+    MemoryPool * pool; // set when the block belongs to a pool
+    size_t liveAllocations;
+    VkDeviceSize usedBytes;
+
+    // general: ranges keyed by offset that cover the whole block, adjacent free ranges are always merged
+    std::map<VkDeviceSize, Range> ranges;
+
+    // linear: bump offset which rewinds to 0 once every allocation in the block is freed
+    VkDeviceSize linearOffset;
+    ResourceTiling lastTiling;
+
+    // pool: indices of unused slots
+    std::vector<uint32_t> freeSlots;
+};
+
+struct MemoryPool {
+    uint32_t memoryType;
+    VkDeviceSize slotSize;
+    uint32_t slotsPerBlock;
+    std::vector<MemoryBlock*> blocks;
+};
+
+GpuAllocator::GpuAllocator(VkPhysicalDevice gpu, VkDevice device, VkDeviceSize preferredBlockSize) : device(device), preferredBlockSize(preferredBlockSize) {
+    vkGetPhysicalDeviceMemoryProperties(gpu, &memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    bufferImageGranularity = properties.limits.bufferImageGranularity;
+    maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+}
+
+GpuAllocator::~GpuAllocator() {
+    destroy();
+}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        // Check if this memory type is included in memoryTypeBits (bitwise AND)
+        if ((memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t memoryTypeBits, MemoryUsage usage) const {
+    const VkMemoryPropertyFlags hostMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkMemoryPropertyFlags required = 0, preferred = 0, avoided = 0;
+    switch (usage) {
+    case MemoryUsage::GpuOnly:
+        required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT; // leave the BAR to dynamic data, integrated GPUs have nothing else
+        break;
+    case MemoryUsage::Upload:
+        required = hostMemory;
+        avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    case MemoryUsage::Readback:
+        required = hostMemory;
+        preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT; // uncached reads are painfully slow
+        break;
+    case MemoryUsage::Dynamic:
+        required = hostMemory;
+        preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT; // written across the bus once, read locally by the GPU
+        break;
+    }
+
+    // lowest cost wins, ties go to the lower index which drivers order by preference
+    uint32_t best = UINT32_MAX;
+    size_t bestCost = SIZE_MAX;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+        if (!(memoryTypeBits & (1 << i)) || (flags & required) != required) {
+            continue;
+        }
+        size_t cost = std::bitset<32>(preferred & ~flags).count() + std::bitset<32>(avoided & flags).count();
+        if (cost < bestCost) {
+            best = i;
+            bestCost = cost;
+        }
+    }
+
+    if (best == UINT32_MAX) {
+        throw std::runtime_error("failed to find a memory type for the requested usage");
+    }
+    return best;
+}
+
+VkDeviceSize GpuAllocator::blockSizeForType(uint32_t memoryType) const {
+    // don't let one block take a big bite out of a small heap, such as the 256MB BAR heap on some discrete cards
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+    return std::min(preferredBlockSize, heapSize / 8);
+}
+
+MemoryBlock * GpuAllocator::createBlock(uint32_t memoryType, VkDeviceSize size, AllocationStrategy strategy, bool dedicated) {
+    if (stats.blockCount >= maxAllocationCount) {
+        throw std::runtime_error("out of device memory allocations (maxMemoryAllocationCount)");
+    }
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryType;
+
+    auto block = std::make_unique<MemoryBlock>();
+    if (VK_SUCCESS != vkAllocateMemory(device, &allocateInfo, nullptr, &block->memory)) {
+        throw std::runtime_error("failed to allocate device memory block");
+    }
+
+    block->size = size;
+    block->mapped = nullptr;
+    block->memoryType = memoryType;
+    block->strategy = strategy;
+    block->dedicated = dedicated;
+    block->pool = nullptr;
+    block->liveAllocations = 0;
+    block->usedBytes = 0;
+    block->linearOffset = 0;
+    block->lastTiling = ResourceTiling::Linear;
+    block->ranges[0] = Range{ size, true, ResourceTiling::Linear };
+
+    // a memory object may only be mapped once, so host visible blocks are mapped up front for every sub-allocation to share
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (VK_SUCCESS != vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped)) {
+            throw std::runtime_error("failed to map device memory block");
+        }
+    }
+
+    stats.blockCount++;
+    stats.deviceAllocationCalls++;
+    stats.blockBytes += size;
+    if (dedicated) {
+        stats.dedicatedBlockCount++;
+    }
+
+    blocks.push_back(std::move(block));
+    return blocks.back().get();
+}
+
+void GpuAllocator::destroyBlock(MemoryBlock * block) {
+    if (block->mapped) {
+        vkUnmapMemory(device, block->memory);
+    }
+    vkFreeMemory(device, block->memory, nullptr);
+
+    stats.blockCount--;
+    stats.blockBytes -= block->size;
+    if (block->dedicated) {
+        stats.dedicatedBlockCount--;
+    }
+
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        if (it->get() == block) {
+            blocks.erase(it);
+            break;
+        }
+    }
+}
+
+bool GpuAllocator::allocateGeneral(MemoryBlock * block, VkDeviceSize size, VkDeviceSize alignment, ResourceTiling tiling, Allocation & out) {
+    // best fit: the smallest free range that holds the request after alignment and granularity padding
+    auto best = block->ranges.end();
+    VkDeviceSize bestOffset = 0;
+
+    for (auto it = block->ranges.begin(); it != block->ranges.end(); ++it) {
+        if (!it->second.free || it->second.size < size) {
+            continue;
+        }
+        VkDeviceSize rangeEnd = it->first + it->second.size;
+        VkDeviceSize offset = alignOffset(it->first, alignment);
+
+        // previous resource of the other tiling on the same page pushes us onto the next page
+        if (it != block->ranges.begin()) {
+            auto previous = std::prev(it); // never free, free neighbours are merged
+            if (previous->second.tiling != tiling && onSamePage(it->first, offset, bufferImageGranularity)) {
+                offset = alignOffset(offset, bufferImageGranularity);
+            }
+        }
+        if (offset + size > rangeEnd) {
+            continue;
+        }
+
+        // a following resource of the other tiling on our last page rules this range out
+        auto next = std::next(it);
+        if (next != block->ranges.end() && next->second.tiling != tiling && onSamePage(offset + size, next->first, bufferImageGranularity)) {
+            continue;
+        }
+
+        if (best == block->ranges.end() || it->second.size < best->second.size) {
+            best = it;
+            bestOffset = offset;
+        }
+    }
+
+    if (best == block->ranges.end()) {
+        return false;
+    }
+
+    VkDeviceSize rangeStart = best->first;
+    VkDeviceSize rangeEnd = rangeStart + best->second.size;
+    block->ranges.erase(best);
+
+    // padding in front stays free, as does anything after the resource
+    if (bestOffset > rangeStart) {
+        block->ranges[rangeStart] = Range{ bestOffset - rangeStart, true, ResourceTiling::Linear };
+    }
+    block->ranges[bestOffset] = Range{ size, false, tiling };
+    if (bestOffset + size < rangeEnd) {
+        block->ranges[bestOffset + size] = Range{ rangeEnd - bestOffset - size, true, ResourceTiling::Linear };
+    }
+
+    out.offset = bestOffset;
+    out.size = size;
+    return true;
+}
+
+bool GpuAllocator::allocateLinear(MemoryBlock * block, VkDeviceSize size, VkDeviceSize alignment, ResourceTiling tiling, Allocation & out) {
+    VkDeviceSize offset = alignOffset(block->linearOffset, alignment);
+    if (block->liveAllocations > 0 && block->lastTiling != tiling && onSamePage(block->linearOffset, offset, bufferImageGranularity)) {
+        offset = alignOffset(offset, bufferImageGranularity);
+    }
+    if (offset + size > block->size) {
+        return false;
+    }
+
+    block->linearOffset = offset + size;
+    block->lastTiling = tiling;
+    out.offset = offset;
+    out.size = size;
+    return true;
+}
+
+Allocation GpuAllocator::allocate(const VkMemoryRequirements & requirements, VkMemoryPropertyFlags properties, ResourceTiling tiling, AllocationStrategy strategy) {
+    return allocateFromType(findMemoryType(requirements.memoryTypeBits, properties), requirements, tiling, strategy);
+}
+
+Allocation GpuAllocator::allocate(const VkMemoryRequirements & requirements, MemoryUsage usage, ResourceTiling tiling, AllocationStrategy strategy) {
+    return allocateFromType(findMemoryType(requirements.memoryTypeBits, usage), requirements, tiling, strategy);
+}
+
+Allocation GpuAllocator::allocateFromType(uint32_t memoryType, const VkMemoryRequirements & requirements, ResourceTiling tiling, AllocationStrategy strategy) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    VkDeviceSize blockSize = blockSizeForType(memoryType);
+
+    Allocation allocation;
+    MemoryBlock * target = nullptr;
+
+    if (requirements.size > blockSize / 2) {
+        // too big to share a block without wasting most of it
+        target = createBlock(memoryType, requirements.size, strategy, true);
+        target->ranges.clear();
+        target->ranges[0] = Range{ requirements.size, false, tiling };
+        allocation.offset = 0;
+        allocation.size = requirements.size;
+    } else {
+        for (auto & block : blocks) {
+            if (block->memoryType != memoryType || block->strategy != strategy || block->dedicated || block->pool) {
+                continue;
+            }
+            bool fits = (strategy == AllocationStrategy::Linear)
+                ? allocateLinear(block.get(), requirements.size, requirements.alignment, tiling, allocation)
+                : allocateGeneral(block.get(), requirements.size, requirements.alignment, tiling, allocation);
+            if (fits) {
+                target = block.get();
+                break;
+            }
+        }
+
+        if (!target) {
+            target = createBlock(memoryType, blockSize, strategy, false);
+            bool fits = (strategy == AllocationStrategy::Linear)
+                ? allocateLinear(target, requirements.size, requirements.alignment, tiling, allocation)
+                : allocateGeneral(target, requirements.size, requirements.alignment, tiling, allocation);
+            if (!fits) {
+                throw std::runtime_error("allocation does not fit in a fresh memory block");
+            }
+        }
+    }
+
+    allocation.memory = target->memory;
+    allocation.block = target;
+    allocation.mapped = target->mapped ? (char*)target->mapped + allocation.offset : nullptr;
+
+    target->liveAllocations++;
+    target->usedBytes += allocation.size;
+    stats.allocationCount++;
+    stats.usedBytes += allocation.size;
+
+    return allocation;
+}
+
+MemoryPool * GpuAllocator::createPool(const VkMemoryRequirements & requirements, MemoryUsage usage, uint32_t slotsPerBlock) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto pool = std::make_unique<MemoryPool>();
+    pool->memoryType = findMemoryType(requirements.memoryTypeBits, usage);
+    // slots are granularity aligned so buffers and optimal images may share a pool block
+    pool->slotSize = alignOffset(requirements.size, std::max(requirements.alignment, bufferImageGranularity));
+    pool->slotsPerBlock = slotsPerBlock;
+
+    pools.push_back(std::move(pool));
+    return pools.back().get();
+}
+
+Allocation GpuAllocator::allocateFromPool(MemoryPool * pool, const VkMemoryRequirements & requirements) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (requirements.size > pool->slotSize || pool->slotSize % requirements.alignment != 0) {
+        throw std::runtime_error("resource does not fit the memory pool's slot size");
+    }
+    if (0 == (requirements.memoryTypeBits & (1 << pool->memoryType))) {
+        throw std::runtime_error("resource cannot use the memory pool's memory type");
+    }
+
+    MemoryBlock * target = nullptr;
+    for (MemoryBlock * block : pool->blocks) {
+        if (!block->freeSlots.empty()) {
+            target = block;
+            break;
+        }
+    }
+
+    if (!target) {
+        target = createBlock(pool->memoryType, pool->slotSize * pool->slotsPerBlock, AllocationStrategy::General, false);
+        target->pool = pool;
+        target->ranges.clear();
+        for (uint32_t i = pool->slotsPerBlock; i > 0; i--) {
+            target->freeSlots.push_back(i - 1); // pop from the back, so the lowest slots go first
+        }
+        pool->blocks.push_back(target);
+    }
+
+    uint32_t slot = target->freeSlots.back();
+    target->freeSlots.pop_back();
+
+    Allocation allocation;
+    allocation.memory = target->memory;
+    allocation.offset = slot * pool->slotSize;
+    allocation.size = pool->slotSize;
+    allocation.block = target;
+    allocation.mapped = target->mapped ? (char*)target->mapped + allocation.offset : nullptr;
+
+    target->liveAllocations++;
+    target->usedBytes += allocation.size;
+    stats.allocationCount++;
+    stats.usedBytes += allocation.size;
+
+    return allocation;
+}
+
+void GpuAllocator::free(const Allocation & allocation) {
+    if (!allocation.block) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MemoryBlock * block = allocation.block;
+    block->liveAllocations--;
+    block->usedBytes -= allocation.size;
+    stats.allocationCount--;
+    stats.usedBytes -= allocation.size;
+
+    if (block->pool) {
+        block->freeSlots.push_back(allocation.offset / block->pool->slotSize);
+        return; // pool blocks live as long as the allocator
+    }
+
+    if (block->dedicated) {
+        destroyBlock(block);
+        return;
+    }
+
+    if (block->strategy == AllocationStrategy::Linear) {
+        if (block->liveAllocations == 0) {
+            block->linearOffset = 0;
+        }
+    } else {
+        auto it = block->ranges.find(allocation.offset);
+        if (it == block->ranges.end() || it->second.free) {
+            throw std::runtime_error("freeing an allocation that is not live");
+        }
+        it->second.free = true;
+
+        auto next = std::next(it);
+        if (next != block->ranges.end() && next->second.free) {
+            it->second.size += next->second.size;
+            block->ranges.erase(next);
+        }
+        if (it != block->ranges.begin()) {
+            auto previous = std::prev(it);
+            if (previous->second.free) {
+                previous->second.size += it->second.size;
+                block->ranges.erase(it);
+            }
+        }
+    }
+
+    // keep one empty block per memory type and strategy around so alternating alloc and free doesn't thrash the driver
+    if (block->liveAllocations == 0) {
+        for (auto & other : blocks) {
+            if (other.get() != block && !other->dedicated && !other->pool
+                && other->memoryType == block->memoryType && other->strategy == block->strategy) {
+                destroyBlock(block);
+                return;
+            }
+        }
+    }
+}
+
+void GpuAllocator::bindBuffer(VkBuffer buffer, const Allocation & allocation) const {
+    if (VK_SUCCESS != vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset)) {
+        throw std::runtime_error("failed to bind buffer memory");
+    }
+}
+
+void GpuAllocator::bindImage(VkImage image, const Allocation & allocation) const {
+    if (VK_SUCCESS != vkBindImageMemory(device, image, allocation.memory, allocation.offset)) {
+        throw std::runtime_error("failed to bind image memory");
+    }
+}
+
+std::string GpuAllocator::describe(const Allocation & allocation) const {
+    if (!allocation.block) {
+        return "not allocated";
+    }
+
+    uint32_t memoryType = allocation.block->memoryType;
+    const VkMemoryType & type = memoryProperties.memoryTypes[memoryType];
+    std::ostringstream out;
+    out << "type " << memoryType << ", heap " << type.heapIndex << " (" << memoryProperties.memoryHeaps[type.heapIndex].size / (1024 * 1024) << " MiB)";
+
+    const std::pair<VkMemoryPropertyFlags, const char *> names[] {
+        { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "device local" },
+        { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "host visible" },
+        { VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "host coherent" },
+        { VK_MEMORY_PROPERTY_HOST_CACHED_BIT, "host cached" },
+    };
+    const char * separator = ", ";
+    for (auto & name : names) {
+        if (type.propertyFlags & name.first) {
+            out << separator << name.second;
+            separator = " | ";
+        }
+    }
+    return out.str();
+}
+
+AllocatorStatistics GpuAllocator::statistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void GpuAllocator::printStatistics(std::ostream & out) const {
+    AllocatorStatistics s = statistics();
+    const double mebibyte = 1024.0 * 1024.0;
+    out << "gpu memory: " << s.allocationCount << " allocations in "
+        << s.blockCount << " blocks (" << s.dedicatedBlockCount << " dedicated), "
+        << s.usedBytes / mebibyte << " of " << s.blockBytes / mebibyte << " MiB used, "
+        << s.deviceAllocationCalls << " vkAllocateMemory calls" << std::endl;
+}
+
+void GpuAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (blocks.empty()) {
+        return;
+    }
+    if (stats.allocationCount > 0) {
+        std::cout << "warning: destroying gpu allocator with " << stats.allocationCount << " live allocations\n";
+    }
+    while (!blocks.empty()) {
+        destroyBlock(blocks.back().get());
+    }
+    pools.clear();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Sub-allocates resource memory out of a few large VkDeviceMemory blocks instead of one vkAllocateMemory per resource.
+// Drivers limit the number of live allocations (maxMemoryAllocationCount, often 4096) and every allocation is a trip
+// into the kernel, so the block count should stay flat while the resource count grows.
+
+// Buffers and linear images must not share a bufferImageGranularity page with optimal images.
+enum class ResourceTiling { Linear, Optimal };
+
+enum class AllocationStrategy {
+    General, // best fit from a free list, for long lived resources of any size
+    Linear, // bump allocated, for transient resources such as staging buffers freed soon after use
+};
+
+// What the CPU and GPU do with a resource's memory, which decides the memory type it gets.  Host visible usages
+// are always host coherent, so writes and reads through Allocation::mapped need no flush or invalidate.
+enum class MemoryUsage {
+    GpuOnly, // only the GPU reads and writes it, static data arrives through a staging upload: device local
+    Upload, // the CPU writes it once for the GPU to copy, such as staging buffers: host visible, kept out of the BAR
+    Readback, // the GPU writes it for the CPU to read: host visible, host cached when there is such memory
+    Dynamic, // the CPU rewrites it every frame for the GPU to read: device local and host visible (the BAR) if possible
+};
+
+struct MemoryBlock;
+struct MemoryPool;
+
+// A piece of a MemoryBlock.  Bind resources at memory + offset, never vkMapMemory the memory yourself:
+// host visible blocks are mapped once for their whole life and mapped already points at offset.
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void * mapped = nullptr;
+    MemoryBlock * block = nullptr;
+};
+
+struct AllocatorStatistics {
+    size_t blockCount = 0; // live VkDeviceMemory objects
+    size_t dedicatedBlockCount = 0; // blocks holding one resource too big to share a block
+    size_t allocationCount = 0; // live sub-allocations
+    size_t deviceAllocationCalls = 0; // vkAllocateMemory calls since creation
+    VkDeviceSize blockBytes = 0; // bytes of device memory held in blocks
+    VkDeviceSize usedBytes = 0; // bytes handed out to resources, including alignment padding
+};
+
+class GpuAllocator {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxAllocationCount;
+    VkDeviceSize preferredBlockSize;
+
+    std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    std::vector<std::unique_ptr<MemoryPool>> pools;
+    AllocatorStatistics stats;
+    mutable std::mutex mutex;
+
+    VkDeviceSize blockSizeForType(uint32_t memoryType) const;
+    MemoryBlock * createBlock(uint32_t memoryType, VkDeviceSize size, AllocationStrategy strategy, bool dedicated);
+    void destroyBlock(MemoryBlock * block);
+    bool allocateGeneral(MemoryBlock * block, VkDeviceSize size, VkDeviceSize alignment, ResourceTiling tiling, Allocation & out);
+    bool allocateLinear(MemoryBlock * block, VkDeviceSize size, VkDeviceSize alignment, ResourceTiling tiling, Allocation & out);
+    Allocation allocateFromType(uint32_t memoryType, const VkMemoryRequirements & requirements, ResourceTiling tiling, AllocationStrategy strategy);
+
+public:
+    GpuAllocator(VkPhysicalDevice gpu, VkDevice device, VkDeviceSize preferredBlockSize = 64ull * 1024 * 1024);
+    ~GpuAllocator();
+
+    uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) const;
+
+    // the memory type with every flag the usage needs and the closest match to the flags it prefers or avoids
+    uint32_t findMemoryType(uint32_t memoryTypeBits, MemoryUsage usage) const;
+
+    Allocation allocate(const VkMemoryRequirements & requirements, VkMemoryPropertyFlags properties, ResourceTiling tiling, AllocationStrategy strategy = AllocationStrategy::General);
+    Allocation allocate(const VkMemoryRequirements & requirements, MemoryUsage usage, ResourceTiling tiling, AllocationStrategy strategy = AllocationStrategy::General);
+
+    // A pool hands out fixed size slots shaped like the given requirements, for many resources of one size.
+    MemoryPool * createPool(const VkMemoryRequirements & requirements, MemoryUsage usage, uint32_t slotsPerBlock);
+    Allocation allocateFromPool(MemoryPool * pool, const VkMemoryRequirements & requirements);
+
+    void free(const Allocation & allocation);
+
+    void bindBuffer(VkBuffer buffer, const Allocation & allocation) const;
+    void bindImage(VkImage image, const Allocation & allocation) const;
+
+    // memory type, heap and property flags an allocation landed in, such as "type 3, heap 1 (256 MiB), device local | host visible | host coherent"
+    std::string describe(const Allocation & allocation) const;
+
+    AllocatorStatistics statistics() const;
+    void printStatistics(std::ostream & out) const;
+
+    // free every block, call before vkDestroyDevice
+    void destroy();
+};
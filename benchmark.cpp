@@ -0,0 +1,466 @@
+#include "benchmark.h"
+#include "parallelrecorder.h"
+#include "tga.h"
+#include "upload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+struct RunDistribution {
+    const char * name;
+    size_t minRun, maxRun; // pixels per packet
+    double repeatedFraction; // share of packets that are runs rather than raw pixels
+};
+
+// an RLE truecolor tga with packets drawn from the distribution
+std::vector<char> makeRleTga(unsigned width, unsigned height, int bpp, const RunDistribution & runs, std::mt19937 & random) {
+    size_t pixelSize = bpp / 8;
+    std::vector<char> bytes(18, 0);
+    bytes[2] = 10;
+    bytes[12] = width & 0xff;
+    bytes[13] = width >> 8;
+    bytes[14] = height & 0xff;
+    bytes[15] = height >> 8;
+    bytes[16] = bpp;
+    bytes[17] = 0x20; // top left origin
+
+    std::uniform_int_distribution<size_t> length(runs.minRun, runs.maxRun);
+    std::bernoulli_distribution repeated(runs.repeatedFraction);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    size_t remaining = (size_t)width * height;
+    while (remaining > 0) {
+        size_t count = std::min(remaining, length(random));
+        bool run = repeated(random);
+        bytes.push_back((char)((run ? 0x80 : 0) | (count - 1)));
+        size_t pixelBytes = (run ? 1 : count) * pixelSize;
+        for (size_t i = 0; i < pixelBytes; i++) {
+            bytes.push_back((char)byte(random));
+        }
+        remaining -= count;
+    }
+    return bytes;
+}
+
+void benchmarkTgaDecode(std::ostream & out) {
+    const unsigned sizes[] = { 256, 1024, 4096 };
+    const int depths[] = { 24, 32 };
+    const RunDistribution distributions[] = {
+        { "short", 1, 4, 0.5 },
+        { "mixed", 1, 128, 0.5 },
+        { "long", 64, 128, 0.9 },
+        { "flat", 128, 128, 1.0 },
+    };
+
+    std::vector<tga_fill> fills;
+    for (tga_fill fill : { tga_fill::scalar, tga_fill::sse2, tga_fill::avx2 }) {
+        if (tga_fill_supported(fill)) {
+            fills.push_back(fill);
+        }
+    }
+    tga_fill previous = get_tga_fill();
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << std::left << std::setw(8) << "bpp" << std::setw(12) << "size" << std::setw(8) << "runs" << std::setw(8) << "fill"
+        << std::right << std::setw(10) << "ms" << std::setw(10) << "MB/s" << std::setw(10) << "speedup" << '\n';
+
+    std::mt19937 random(1);
+    for (int bpp : depths) {
+        for (unsigned size : sizes) {
+            for (const RunDistribution & runs : distributions) {
+                std::vector<char> bytes = makeRleTga(size, size, bpp, runs, random);
+                tga_info info = read_tga_info(bytes.data(), bytes.size());
+
+                // decode the same image at least a few times and about 256MiB in total
+                size_t repeats = std::max<size_t>(3, (256u << 20) / info.pixels_size);
+                std::vector<char> reference(info.pixels_size);
+                std::vector<char> decoded(info.pixels_size);
+                double scalarMs = 0.0;
+
+                for (tga_fill fill : fills) {
+                    set_tga_fill(fill);
+                    decode_tga(bytes.data(), bytes.size(), info, decoded.data());
+                    if (fill == tga_fill::scalar) {
+                        reference = decoded;
+                    } else if (memcmp(reference.data(), decoded.data(), info.pixels_size) != 0) {
+                        set_tga_fill(previous);
+                        throw std::runtime_error(std::string("tga decode with ") + tga_fill_name(fill) + " differs from scalar");
+                    }
+
+                    auto begin = std::chrono::steady_clock::now();
+                    for (size_t i = 0; i < repeats; i++) {
+                        decode_tga(bytes.data(), bytes.size(), info, decoded.data());
+                    }
+                    auto end = std::chrono::steady_clock::now();
+                    double ms = std::chrono::duration<double, std::milli>(end - begin).count() / repeats;
+                    if (fill == tga_fill::scalar) {
+                        scalarMs = ms;
+                    }
+
+                    out << std::left << std::setw(8) << bpp << std::setw(12) << (std::to_string(size) + "x" + std::to_string(size))
+                        << std::setw(8) << runs.name << std::setw(8) << tga_fill_name(fill)
+                        << std::right << std::fixed << std::setprecision(3) << std::setw(10) << ms
+                        << std::setprecision(0) << std::setw(10) << info.pixels_size / (ms * 1e3)
+                        << std::setprecision(2) << std::setw(9) << scalarMs / ms << "x\n";
+                }
+            }
+        }
+    }
+
+    set_tga_fill(previous);
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// a mutable RGBA image both paths can build mips in, sampled as sRGB
+std::tuple<VkImage, Allocation> createMipBenchmarkImage(GpuAllocator & allocator, VkDevice device, uint32_t size, uint32_t mipLevels, bool storage) {
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = { size, size, 1 };
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (storage) {
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+    if (VK_SUCCESS != vkCreateImage(device, &imageInfo, nullptr, &image)) {
+        throw std::runtime_error("failed to create mip benchmark image");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+    Allocation allocation = allocator.allocate(memoryRequirements, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+    allocator.bindImage(image, allocation);
+    return std::make_tuple(image, allocation);
+}
+
+void benchmarkMipGeneration(std::ostream & out, VkPhysicalDevice gpu, VkDevice device, GpuAllocator & allocator, VkQueue queue, uint32_t queueFamily, VkCommandPool commandPool, MipGenerator & generator) {
+    const uint32_t sizes[] = { 4096, 8192 };
+    const int runs = 5;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+        out << "mip benchmark skipped, the queue family does not support timestamps\n";
+        return;
+    }
+    uint64_t timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+    bool computable = generator.storageFormat(VK_FORMAT_R8G8B8A8_SRGB) != VK_FORMAT_UNDEFINED;
+
+    VkQueryPoolCreateInfo queryInfo = {};
+    queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = 2;
+    VkQueryPool queryPool;
+    if (VK_SUCCESS != vkCreateQueryPool(device, &queryInfo, nullptr, &queryPool)) {
+        throw std::runtime_error("failed to create mip benchmark query pool");
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if (VK_SUCCESS != vkCreateFence(device, &fenceInfo, nullptr, &fence)) {
+        throw std::runtime_error("failed to create mip benchmark fence");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer)) {
+        throw std::runtime_error("failed to allocate mip benchmark command buffer");
+    }
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::left << std::setw(12) << "size" << std::setw(10) << "path"
+        << std::right << std::setw(10) << "min ms" << std::setw(10) << "mean ms" << '\n';
+
+    for (uint32_t size : sizes) {
+        uint32_t mipLevels = std::floor(std::log2(size)) + 1;
+        VkImage image;
+        Allocation allocation;
+        std::tie(image, allocation) = createMipBenchmarkImage(allocator, device, size, mipLevels, computable);
+
+        for (bool compute : { false, true }) {
+            if (compute && !computable) {
+                out << std::left << std::setw(12) << (std::to_string(size) + "x" + std::to_string(size)) << "compute unsupported\n";
+                continue;
+            }
+
+            double minMs = 0.0, totalMs = 0.0;
+            for (int run = 0; run < runs; run++) {
+                VkCommandBufferBeginInfo beginInfo = {};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+                    throw std::runtime_error("failed to begin mip benchmark command buffer");
+                }
+                vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+
+                // level 0 gets a clear in place of an upload, then every level is where the upload would leave it
+                VkImageMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+                VkClearColorValue color = {{ 0.25f, 0.5f, 0.75f, 1.0f }};
+                VkImageSubresourceRange level0 = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+                vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &level0);
+
+                std::function<void()> release;
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+                if (compute) {
+                    release = generator.record(commandBuffer, image, VK_FORMAT_R8G8B8A8_SRGB, size, size, mipLevels);
+                } else {
+                    recordMipmaps(commandBuffer, image, size, size, mipLevels);
+                }
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+                if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+                    throw std::runtime_error("failed to end mip benchmark command buffer");
+                }
+                VkSubmitInfo submitInfo = {};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &commandBuffer;
+                if (VK_SUCCESS != vkQueueSubmit(queue, 1, &submitInfo, fence)) {
+                    throw std::runtime_error("failed to submit mip benchmark");
+                }
+                if (VK_SUCCESS != vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX)) {
+                    throw std::runtime_error("failed to wait for mip benchmark");
+                }
+                vkResetFences(device, 1, &fence);
+                if (release) {
+                    release();
+                }
+
+                uint64_t timestamps[2];
+                if (VK_SUCCESS != vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)) {
+                    throw std::runtime_error("failed to read mip benchmark timestamps");
+                }
+                double ms = ((timestamps[1] - timestamps[0]) & timestampMask) * properties.limits.timestampPeriod / 1e6;
+                minMs = (run == 0) ? ms : std::min(minMs, ms);
+                totalMs += ms;
+            }
+
+            out << std::left << std::setw(12) << (std::to_string(size) + "x" + std::to_string(size)) << std::setw(10) << (compute ? "compute" : "blit")
+                << std::right << std::fixed << std::setprecision(3) << std::setw(10) << minMs << std::setw(10) << totalMs / runs << '\n';
+        }
+
+        vkDestroyImage(device, image, nullptr);
+        allocator.free(allocation);
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+// tens of microseconds of arithmetic the compiler cannot drop, since the result is kept
+double jobWork(size_t seed) {
+    double x = seed + 1.0;
+    for (int i = 0; i < 4000; i++) {
+        x = std::sqrt(x * 1.0001 + i);
+    }
+    return x;
+}
+
+void benchmarkJobSystem(std::ostream & out) {
+    const size_t emptyJobs = 200000;
+    const size_t spawners = 64;
+    const size_t workItems = 8192;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    {
+        JobSystem jobs(JobSystem::defaultWorkerCount());
+        out << "scheduling overhead with " << jobs.workerCount() << " workers and the main thread\n";
+
+        auto begin = std::chrono::steady_clock::now();
+        JobCounter counter;
+        for (size_t i = 0; i < emptyJobs; i++) {
+            jobs.run([]() {}, &counter);
+        }
+        jobs.wait(counter);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / emptyJobs;
+        out << std::left << std::setw(28) << "  queued by the main thread" << std::right << std::fixed << std::setprecision(0) << std::setw(8) << ns << " ns/job\n";
+
+        // jobs spawning jobs push to their worker's own deque, the common case once work is under way
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < spawners; i++) {
+            jobs.run([&jobs, &counter]() {
+                for (size_t j = 0; j < emptyJobs / spawners; j++) {
+                    jobs.run([]() {}, &counter);
+                }
+            }, &counter);
+        }
+        jobs.wait(counter);
+        ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / emptyJobs;
+        out << std::left << std::setw(28) << "  spawned by jobs" << std::right << std::setw(8) << ns << " ns/job\n";
+    }
+
+    size_t hardwareThreads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < hardwareThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    out << "scaling over " << workItems << " jobs of tens of microseconds\n";
+    out << std::left << std::setw(10) << "threads" << std::right << std::setw(10) << "ms" << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << '\n';
+
+    std::vector<double> results(workItems);
+    double singleMs = 0.0;
+    for (size_t threads : threadCounts) {
+        JobSystem jobs(threads - 1); // the main thread helps while it waits, so it is one of the threads
+        double bestMs = 0.0;
+        for (int run = 0; run < 3; run++) {
+            auto begin = std::chrono::steady_clock::now();
+            jobs.parallelFor(workItems, 16, [&results](size_t first, size_t end) {
+                for (size_t i = first; i < end; i++) {
+                    results[i] = jobWork(i);
+                }
+            });
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            bestMs = (run == 0) ? ms : std::min(bestMs, ms);
+        }
+        if (threads == 1) {
+            singleMs = bestMs;
+        }
+        double speedup = singleMs / bestMs;
+        out << std::left << std::setw(10) << threads << std::right << std::fixed << std::setprecision(2) << std::setw(10) << bestMs
+            << std::setw(9) << speedup << "x" << std::setprecision(0) << std::setw(11) << 100.0 * speedup / threads << "%\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void benchmarkCommandRecording(std::ostream & out, VkDevice device, uint32_t queueFamily, VkCommandPool commandPool, VkRenderPass renderPass, VkFramebuffer framebuffer,
+        VkExtent2D extent, const std::function<void(VkCommandBuffer commandBuffer, size_t drawCount, size_t firstDraw, size_t endDraw)> & recordDraws) {
+    const size_t drawCounts[] = { 1000, 10000, 100000 };
+    const int runs = 5;
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer)) {
+        throw std::runtime_error("failed to allocate recording benchmark command buffer");
+    }
+
+    VkClearValue clearValues[2];
+    clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    clearValues[1].depthStencil = { 1.0f, 0 };
+    VkRenderPassBeginInfo renderPassBeginInfo = {};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.framebuffer = framebuffer;
+    renderPassBeginInfo.renderArea.extent = extent;
+    renderPassBeginInfo.clearValueCount = 2;
+    renderPassBeginInfo.pClearValues = clearValues;
+
+    // the best of several runs of one recording of the primary, recorder is null for inline draws
+    auto timeRecording = [&](size_t drawCount, ParallelRecorder * recorder) {
+        double bestMs = 0.0;
+        for (int run = 0; run < runs; run++) {
+            auto begin = std::chrono::steady_clock::now();
+            vkResetCommandBuffer(commandBuffer, 0);
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+                throw std::runtime_error("failed to begin recording benchmark command buffer");
+            }
+            if (!recorder) {
+                vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+                recordDraws(commandBuffer, drawCount, 0, drawCount);
+            } else {
+                const std::vector<VkCommandBuffer> & secondaries = recorder->record(0, renderPass, framebuffer, false, drawCount,
+                    [&](VkCommandBuffer secondary, size_t firstDraw, size_t endDraw) { recordDraws(secondary, drawCount, firstDraw, endDraw); });
+                vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+                vkCmdExecuteCommands(commandBuffer, secondaries.size(), secondaries.data());
+            }
+            vkCmdEndRenderPass(commandBuffer);
+            if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
+                throw std::runtime_error("failed to end recording benchmark command buffer");
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            bestMs = (run == 0) ? ms : std::min(bestMs, ms);
+        }
+        return bestMs;
+    };
+
+    size_t hardwareThreads = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < hardwareThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "command recording, best of " << runs << " runs\n";
+    out << std::left << std::setw(10) << "draws" << std::setw(12) << "threads" << std::right << std::setw(10) << "ms" << std::setw(10) << "speedup" << '\n';
+
+    for (size_t drawCount : drawCounts) {
+        double inlineMs = timeRecording(drawCount, nullptr);
+        out << std::left << std::setw(10) << drawCount << std::setw(12) << "inline" << std::right << std::fixed << std::setprecision(2)
+            << std::setw(10) << inlineMs << std::setw(9) << 1.0 << "x\n";
+
+        for (size_t threads : threadCounts) {
+            JobSystem jobs(threads - 1); // the main thread records too while it waits
+            ParallelRecorder recorder(device, queueFamily, jobs, threads);
+            recorder.setTargetCount(1);
+            double ms = timeRecording(drawCount, &recorder);
+            out << std::left << std::setw(10) << drawCount << std::setw(12) << threads << std::right << std::setw(10) << ms
+                << std::setw(9) << inlineMs / ms << "x\n";
+            recorder.destroy(); // nothing was submitted, so the secondaries are not pending
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+#include "allocator.h"
+#include "jobsystem.h"
+#include "mipgenerator.h"
+
+// Decode synthetic RLE images of 24 and 32 bits, several sizes and run length distributions, with every fill the
+// CPU supports.  Checks that all of them produce the same bytes and prints decode time and throughput.
+void benchmarkTgaDecode(std::ostream & out);
+
+// Build full mip chains of 4096x4096 and 8192x8192 sRGB images with blits and with the mip generator, timing each
+// path with timestamp queries on the queue over several runs and printing min and mean GPU time.  The queue must
+// support graphics, the command pool must be of its family.
+void benchmarkMipGeneration(std::ostream & out, VkPhysicalDevice gpu, VkDevice device, GpuAllocator & allocator, VkQueue queue, uint32_t queueFamily, VkCommandPool commandPool, MipGenerator & generator);
+
+// Time empty jobs queued from the main thread and spawned from inside jobs, for the scheduling overhead per job, then
+// run a fixed CPU bound workload with 1 thread up to every hardware thread and print speedup and efficiency.
+void benchmarkJobSystem(std::ostream & out);
+
+// Record a render pass of 1000, 10000 and 100000 draws into a primary from commandPool, with the draws inline and then
+// in secondaries on jobs, 1 thread up to every hardware thread with one secondary each, and print recording time and
+// speedup over inline.  Nothing is submitted.  recordDraws records draws [firstDraw, endDraw) of drawCount and binds
+// what they use, the render pass and framebuffer must be compatible with the pipeline it binds.
+void benchmarkCommandRecording(std::ostream & out, VkDevice device, uint32_t queueFamily, VkCommandPool commandPool, VkRenderPass renderPass, VkFramebuffer framebuffer,
+    VkExtent2D extent, const std::function<void(VkCommandBuffer commandBuffer, size_t drawCount, size_t firstDraw, size_t endDraw)> & recordDraws);
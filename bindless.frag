@@ -0,0 +1,13 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+layout(location = 0) out vec4 outColor;
+layout(location = 1) in vec2 uv;
+layout(location = 2) flat in uint textureSlot;
+
+// the texture table, set 1, of which only the slots frames list are written
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+void main() {
+    // one draw covers quads of many textures, so the index may differ between neighbouring fragments
+    outColor = texture(textures[nonuniformEXT(textureSlot)], uv);
+}
@@ -140,6 +140,6 @@ vec3f Camera::getLocation() const {
 }
 
 Vec3<float> Camera::getDirection() const {
-    mat16f inverse = view.inverted();
+    mat16f inverse = view.affineInverted(); // the view is only rotation and translation
     return inverse * vec3f(0,0,-1); // This is not the current z-axis, but the opengl convention axis.
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "deletionqueue.h"
+
+DeletionQueue::DeletionQueue(VkDevice device, GpuAllocator & allocator) : device(device), allocator(allocator) {
+}
+
+DeletionQueue::~DeletionQueue() {
+    destroy();
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkBuffer buffer) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroyBuffer(device, buffer, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkImage image) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroyImage(device, image, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkImageView view) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroyImageView(device, view, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkFramebuffer framebuffer) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroyFramebuffer(device, framebuffer, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkPipeline pipeline) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroyPipeline(device, pipeline, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkSemaphore semaphore) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroySemaphore(device, semaphore, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkSwapchainKHR swapchain) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkDestroySwapchainKHR(device, swapchain, nullptr); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, VkDescriptorPool pool, VkDescriptorSet set) {
+    VkDevice device = this->device;
+    pending.push_back(Pending{ lastUse, [=]() { vkFreeDescriptorSets(device, pool, 1, &set); } });
+}
+
+void DeletionQueue::push(uint64_t lastUse, const Allocation & allocation) {
+    GpuAllocator * allocator = &this->allocator;
+    pending.push_back(Pending{ lastUse, [=]() { allocator->free(allocation); } });
+}
+
+void DeletionQueue::collect(uint64_t completed) {
+    // entries are mostly in lastUse order, but one pushed with an older point must not wait for newer ones
+    size_t kept = 0;
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i].lastUse <= completed) {
+            pending[i].destroy();
+        } else {
+            if (kept != i) {
+                pending[kept] = std::move(pending[i]);
+            }
+            kept++;
+        }
+    }
+    pending.resize(kept);
+}
+
+void DeletionQueue::destroy() {
+    for (Pending & entry : pending) {
+        entry.destroy();
+    }
+    pending.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "allocator.h"
+
+// Destroys Vulkan objects once the GPU is done with them, instead of waiting for the device to go idle.
+// Each object is pushed with the last point on a GPU timeline that may use it: a frame number here, though any
+// value that grows monotonically and whose completion the caller can observe works, such as a timeline semaphore's
+// counter.  collect destroys everything whose point is complete, in the order it was pushed, so push a resource
+// before the memory bound to it and a view before its image.
+class DeletionQueue {
+    struct Pending {
+        uint64_t lastUse;
+        std::function<void()> destroy;
+    };
+
+    VkDevice device;
+    GpuAllocator & allocator;
+    std::vector<Pending> pending;
+
+public:
+    DeletionQueue(VkDevice device, GpuAllocator & allocator);
+    ~DeletionQueue();
+
+    void push(uint64_t lastUse, VkBuffer buffer);
+    void push(uint64_t lastUse, VkImage image);
+    void push(uint64_t lastUse, VkImageView view);
+    void push(uint64_t lastUse, VkFramebuffer framebuffer);
+    void push(uint64_t lastUse, VkPipeline pipeline);
+    void push(uint64_t lastUse, VkSemaphore semaphore);
+    void push(uint64_t lastUse, VkSwapchainKHR swapchain);
+    void push(uint64_t lastUse, VkDescriptorPool pool, VkDescriptorSet set); // the pool needs FREE_DESCRIPTOR_SET_BIT
+    void push(uint64_t lastUse, const Allocation & allocation);
+
+    // Destroy everything last used at or before completed.  Cheap when nothing is due, call once per frame.
+    void collect(uint64_t completed);
+
+    size_t pendingCount() const { return pending.size(); }
+
+    // destroy everything still pending, call once the device is idle and before destroying the allocator
+    void destroy();
+};
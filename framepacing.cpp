@@ -0,0 +1,107 @@
+#include "framepacing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+namespace {
+
+double percentile(std::vector<double> values, double fraction) {
+    size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+}
+
+FramePacing::FramePacing() : hasPresent(false) {
+}
+
+void FramePacing::submitted(Clock::time_point inputSampled, Clock::time_point submit) {
+    double ms = std::chrono::duration<double, std::milli>(submit - inputSampled).count();
+    recent.latencyMs.push_back(ms);
+    allLatency.add(ms);
+}
+
+void FramePacing::presented(Clock::time_point present) {
+    if (hasPresent) {
+        double ms = std::chrono::duration<double, std::milli>(present - lastPresent).count();
+        recent.frameMs.push_back(ms);
+        allFrames.add(ms);
+    }
+    lastPresent = present;
+    hasPresent = true;
+}
+
+void FramePacing::restart() {
+    hasPresent = false;
+}
+
+void FramePacing::Totals::add(double ms) {
+    count++;
+    sum += ms;
+    sumSquares += ms * ms;
+    max = std::max(max, ms);
+    buckets[std::min(bucketCount - 1, (size_t)(std::max(0.0, ms) / bucketMs))]++;
+}
+
+// the upper edge of the bucket holding the percentile, or the max when that is the overflow bucket
+double FramePacing::Totals::percentile(double fraction) const {
+    size_t rank = std::min(count - 1, (size_t)(fraction * count));
+    size_t seen = 0;
+    for (size_t i = 0; i + 1 < bucketCount; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return std::min(max, (i + 1) * bucketMs);
+        }
+    }
+    return max;
+}
+
+void FramePacing::print(std::ostream & out, const char * label, const Stats & stats) {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << label << ": " << std::fixed << std::setprecision(2)
+        << "input to submit mean " << stats.latencyMean << "ms p99 " << stats.latencyP99 << "ms max " << stats.latencyMax
+        << "ms, frame time mean " << stats.frameMean << "ms jitter " << stats.jitter << "ms p99 " << stats.frameP99 << "ms over "
+        << stats.frames << " frames" << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void FramePacing::report(std::ostream & out, const char * mode) {
+    if (!recent.latencyMs.empty() && !recent.frameMs.empty()) {
+        Stats stats;
+        stats.latencyMean = std::accumulate(recent.latencyMs.begin(), recent.latencyMs.end(), 0.0) / recent.latencyMs.size();
+        stats.latencyP99 = percentile(recent.latencyMs, 0.99);
+        stats.latencyMax = *std::max_element(recent.latencyMs.begin(), recent.latencyMs.end());
+        stats.frameMean = std::accumulate(recent.frameMs.begin(), recent.frameMs.end(), 0.0) / recent.frameMs.size();
+        double variance = 0.0;
+        for (double ms : recent.frameMs) {
+            variance += (ms - stats.frameMean) * (ms - stats.frameMean);
+        }
+        stats.jitter = std::sqrt(variance / recent.frameMs.size());
+        stats.frameP99 = percentile(recent.frameMs, 0.99);
+        stats.frames = recent.frameMs.size();
+        print(out, mode, stats);
+    }
+    recent.latencyMs.clear();
+    recent.frameMs.clear();
+}
+
+void FramePacing::summary(std::ostream & out, const char * mode) const {
+    if (allLatency.count == 0 || allFrames.count == 0) {
+        return;
+    }
+    Stats stats;
+    stats.latencyMean = allLatency.mean();
+    stats.latencyP99 = allLatency.percentile(0.99);
+    stats.latencyMax = allLatency.max;
+    stats.frameMean = allFrames.mean();
+    double variance = allFrames.sumSquares / allFrames.count - stats.frameMean * stats.frameMean;
+    stats.jitter = std::sqrt(std::max(0.0, variance)); // rounding can leave a tiny negative
+    stats.frameP99 = allFrames.percentile(0.99);
+    stats.frames = allFrames.count;
+    print(out, mode, stats);
+}
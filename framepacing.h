@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Input to submit latency and present to present frame time of the window's frame loop, to compare rendering on the
+// main thread with rendering on its own thread.  Latency is the age, at submit, of the input the frame was built
+// from; jitter is the standard deviation of the frame time.  Reports cover the frames since the previous report and
+// keep their samples; the summary of the whole run keeps running sums and a fixed histogram instead, so its memory
+// stays flat however long the window is open, and its 99th percentiles are to the histogram's bucket width.
+class FramePacing {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    struct Samples {
+        std::vector<double> latencyMs;
+        std::vector<double> frameMs;
+    };
+
+    // count, sum, sum of squares, max and a histogram of 0.1ms buckets, the last of which holds everything longer
+    struct Totals {
+        static const size_t bucketCount = 2000;
+        static constexpr double bucketMs = 0.1;
+
+        size_t count = 0;
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        double max = 0.0;
+        std::vector<uint32_t> buckets = std::vector<uint32_t>(bucketCount);
+
+        void add(double ms);
+        double mean() const { return sum / count; }
+        double percentile(double fraction) const;
+    };
+
+    // what print shows, from either
+    struct Stats {
+        double latencyMean, latencyP99, latencyMax;
+        double frameMean, jitter, frameP99;
+        size_t frames;
+    };
+
+    Samples recent; // since the last report
+    Totals allLatency;
+    Totals allFrames;
+    Clock::time_point lastPresent;
+    bool hasPresent;
+
+    static void print(std::ostream & out, const char * label, const Stats & stats);
+
+public:
+    FramePacing();
+
+    void submitted(Clock::time_point inputSampled, Clock::time_point submit);
+    void presented(Clock::time_point present);
+
+    // the next present starts a new interval rather than ending one, for gaps that are not frame time such as a
+    // swap chain recreate, which is reported as a resize hitch instead
+    void restart();
+
+    // mean, 99th percentile and max of latency, mean frame time and jitter of the recent frames, then forget them
+    void report(std::ostream & out, const char * mode);
+
+    // the same over every frame
+    void summary(std::ostream & out, const char * mode) const;
+};
@@ -0,0 +1,194 @@
+#include "jobsystem.h"
+
+#include <algorithm>
+
+namespace {
+
+// which system's worker this thread is, if any
+thread_local const JobSystem * currentSystem = nullptr;
+thread_local size_t currentQueue = 0;
+
+}
+
+size_t JobSystem::defaultWorkerCount() {
+    size_t threads = std::thread::hardware_concurrency(); // 0 when unknown
+    return std::max<size_t>(threads, 2) - 1;
+}
+
+JobSystem::JobSystem(size_t workerCount) : queued(0), stopping(false) {
+    for (size_t i = 0; i < workerCount + 1; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&JobSystem::work, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    destroy();
+}
+
+size_t JobSystem::queueOfThisThread() const {
+    return currentSystem == this ? currentQueue : queues.size() - 1;
+}
+
+void JobSystem::push(Job job, JobCounter * counter) {
+    queued++; // before the push, so a job is never taken before it is counted
+    {
+        Queue & queue = *queues[queueOfThisThread()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.emplace_back(std::move(job), counter);
+    }
+    // a worker checks queued under sleepMutex before sleeping, so taking it here means the notify cannot be missed
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+void JobSystem::run(Job job, JobCounter * counter) {
+    if (counter) {
+        counter->pending++;
+    }
+    push(std::move(job), counter);
+}
+
+void JobSystem::runAfter(JobCounter & dependency, Job job, JobCounter * counter) {
+    if (counter) {
+        counter->pending++;
+    }
+    std::unique_lock<std::mutex> lock(dependency.mutex);
+    if (dependency.pending.load() != 0) {
+        // the job that takes pending to 0 schedules the continuations under this mutex, so this one cannot be missed
+        dependency.continuations.emplace_back(std::move(job), counter);
+        return;
+    }
+    lock.unlock();
+    push(std::move(job), counter);
+}
+
+bool JobSystem::runOne() {
+    size_t self = queueOfThisThread();
+    bool worker = currentSystem == this;
+    std::pair<Job, JobCounter*> task;
+    bool found = false;
+
+    {
+        // workers take their newest job, other threads share a queue that runs oldest first
+        Queue & own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            if (worker) {
+                task = std::move(own.jobs.back());
+                own.jobs.pop_back();
+            } else {
+                task = std::move(own.jobs.front());
+                own.jobs.pop_front();
+            }
+            found = true;
+        }
+    }
+    for (size_t i = 1; !found && i < queues.size(); i++) {
+        Queue & victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            task = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    queued--;
+
+    JobCounter * counter = task.second;
+    try {
+        task.first();
+    } catch (...) {
+        if (!counter) {
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (!counter->error) {
+            counter->error = std::current_exception();
+        }
+    }
+    finished(counter);
+    return true;
+}
+
+void JobSystem::finished(JobCounter * counter) {
+    if (!counter) {
+        return;
+    }
+    // a waiter may destroy the counter as soon as it is done, which finishing holds off until the last touch below
+    counter->finishing++;
+    if (counter->pending.fetch_sub(1) == 1) {
+        std::vector<std::pair<Job, JobCounter*>> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            ready.swap(counter->continuations);
+        }
+        for (auto & continuation : ready) {
+            push(std::move(continuation.first), continuation.second);
+        }
+    }
+    counter->finishing--;
+}
+
+void JobSystem::work(size_t index) {
+    currentSystem = this;
+    currentQueue = index;
+    for (;;) {
+        if (runOne()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> & body) {
+    grain = std::max<size_t>(grain, 1);
+    JobCounter counter;
+    for (size_t begin = 0; begin < count; begin += grain) {
+        size_t end = std::min(count, begin + grain);
+        run([&body, begin, end]() { body(begin, end); }, &counter);
+    }
+    wait(counter);
+}
+
+void JobSystem::wait(JobCounter & counter) {
+    while (!counter.done()) {
+        if (!runOne()) {
+            std::this_thread::yield(); // the remaining jobs are running elsewhere
+        }
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        std::swap(error, counter.error);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // with no workers nothing else runs what is left
+    while (runOne()) {
+    }
+}
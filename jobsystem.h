@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+class JobSystem;
+
+// Counts jobs that have not finished yet.  Pass one to JobSystem::run for every job it should cover, then wait on it
+// or make later jobs depend on it with runAfter.  A counter may be destroyed once JobSystem::wait returned.
+class JobCounter {
+    friend class JobSystem;
+
+    std::atomic<size_t> pending;
+    std::atomic<size_t> finishing; // jobs between their decrement and their last touch of the counter
+    std::mutex mutex;
+    std::vector<std::pair<Job, JobCounter*>> continuations; // runAfter jobs, scheduled when pending reaches 0
+    std::exception_ptr error; // the first exception a covered job threw
+
+public:
+    JobCounter() : pending(0), finishing(0) {}
+    JobCounter(const JobCounter &) = delete;
+    JobCounter & operator=(const JobCounter &) = delete;
+
+    bool done() const { return pending.load() == 0 && finishing.load() == 0; }
+};
+
+// Runs jobs on a fixed set of worker threads.  Each worker has a deque it pushes to and pops from the back of, so the
+// job a worker spawned last runs next while its data is still in cache; idle workers steal from the front of the other
+// deques, taking the oldest and usually largest work.  Threads that are not workers, the main thread in particular,
+// push to a shared deque and help run jobs while they wait, so a system with no workers still makes progress.
+class JobSystem {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::pair<Job, JobCounter*>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, the last for every other thread
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued; // jobs pushed and not yet taken, raised before the push so it never goes below 0
+    std::mutex sleepMutex;
+    std::condition_variable wake; // a job was queued, or workers should stop
+    bool stopping;
+
+    size_t queueOfThisThread() const;
+    void push(Job job, JobCounter * counter);
+    bool runOne(); // take a job from this thread's queue or steal one, and run it
+    void finished(JobCounter * counter);
+    void work(size_t index);
+
+public:
+    // one less than the hardware threads, leaving one for the main thread, and at least one
+    static size_t defaultWorkerCount();
+
+    explicit JobSystem(size_t workerCount);
+    ~JobSystem();
+
+    // Queue a job, safe from any thread including from inside a job.  Exceptions the job throws are rethrown by
+    // wait on its counter; without a counter the job must not throw.
+    void run(Job job, JobCounter * counter = nullptr);
+
+    // queue a job once every job covered by dependency has finished, counter covers it from now on
+    void runAfter(JobCounter & dependency, Job job, JobCounter * counter = nullptr);
+
+    // Split [0, count) into ranges of at most grain and run body on each, returning once all of them finished.
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> & body);
+
+    // Run queued jobs on this thread until every job covered by the counter has finished, then rethrow the first
+    // exception one of them threw.  Safe from inside a job.
+    void wait(JobCounter & counter);
+
+    size_t workerCount() const { return workers.size(); }
+
+    // finish every queued job and join the workers
+    void destroy();
+};
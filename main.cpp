@@ -7,11 +7,36 @@
 #include <vulkan/vulkan_core.h>
 #include <vector>
 #include <set>
+#include <tuple>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
 #include <assert.h>
 
 #include "tga.h"
 #include "math.h"
 #include "camera.h"
+#include "allocator.h"
+#include "upload.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "pipelinecache.h"
+#include "prerecorded.h"
+#include "parallelrecorder.h"
+#include "spscqueue.h"
+#include "framepacing.h"
+#include "texturetable.h"
+#include "deletionqueue.h"
+#include "uniformring.h"
+#include "texturestreamer.h"
+#include "mipgenerator.h"
+#include "jobsystem.h"
+#include "startup.h"
 
 // Global Settings
 const char * appName = "VulkanTest";
@@ -27,6 +52,32 @@ VkFormat depthFormat = VK_FORMAT_D24_UNORM_S8_UINT; // some options are VK_FORMA
 
 #define COMPUTE_VERTICES // comment out to try CPU uploaded vertex buffer
 size_t quadCount = 100;
+uint32_t preferredWorkgroupSize = 256; // invocations per compute workgroup, lowered to what the device allows
+size_t maxQuadBufferBytes = 256 << 20; // vertex storage for quads that survive culling, the rest are dropped
+bool quadSweep = false; // headless runs repeat for 1e2 to 1e7 quads and report each
+size_t framesInFlight = 2; // how many frames the CPU may record ahead of the GPU, 2 or 3
+bool gpuProfile = false; // time GPU work with timestamp queries and print a summary every few seconds
+std::string gpuProfileCsv; // when set, also write every frame's GPU timings to this file
+size_t headlessFrames = 0; // when non-zero, render this many frames offscreen with no window or swapchain, then write a JSON report
+std::string reportFile = "benchmark.json"; // where the headless JSON report goes
+int gpuSelection = -1; // index of the physical device to use, -1 asks when there is more than one
+std::string pipelineCacheFile = "pipeline.cache"; // pipelines compiled by earlier runs, empty to always start cold
+bool prerecordCommands = false; // record one command buffer per swapchain image once and replay it until invalidated
+VkDeviceSize uniformBytesPerFrame = 64 * 1024; // uniform ring region of each frame, room for per draw data
+bool drainOnResize = false; // wait for the device to idle before recreating the swap chain, to compare resize hitches
+size_t jobWorkers = 0; // worker threads of the job system, 0 for one less than the hardware threads
+bool asyncCompute = false; // generate vertices on a compute-only queue, overlapping the previous frame's draw
+bool singleQueue = false; // upload on the graphics queue even when the device has a dedicated transfer queue
+bool computeMips = true; // build texture mip chains with one compute dispatch where the format allows, blits otherwise
+bool benchmarkMips = false; // time blit and compute mip generation of large images before the first frame
+bool benchmarkTga = false; // time tga decoding of synthetic images and exit, no Vulkan or SDL involved
+bool benchmarkJobs = false; // time job scheduling and scaling over thread counts and exit, no Vulkan or SDL involved
+size_t drawCount = 1; // split the quads into this many draws, 1 draws compute's vertices with one indirect draw
+size_t recordChunks = 0; // record the draws into this many secondary command buffers on jobs, 0 records them inline
+bool benchmarkRecording = false; // time render pass recording inline and on 1 up to every hardware thread before the first frame
+bool renderThread = false; // render the window's frames on a thread of their own, leaving the main thread to events and simulation
+bool bindlessTextures = false; // quads pick their texture from one descriptor array by index, needs descriptor indexing
+std::vector<std::string> extraTextures; // streamed beside vulkan.tga, quads cycle through all of them with bindless textures
 
 struct PipelineInfo {
     float w, h;
@@ -34,11 +85,27 @@ struct PipelineInfo {
     VkFormat colorFormat;
 } pipelineInfo;
 
-std::vector<char> readFileBytes(std::istream & file) {
-    return std::vector<char>(
-        std::istreambuf_iterator<char>(file),
-        std::istreambuf_iterator<char>());
-}
+// how the vertex generation dispatch covers quadCount
+struct QuadDispatch {
+    uint32_t workgroupSize; // local_size_x, through specialization constant 0
+    uint32_t groupCountX, groupCountY;
+    uint32_t quadCapacity; // quads each region of vertex storage holds
+} quadDispatch;
+
+// matches the push constants of vertices.comp
+struct QuadPushConstants {
+    uint32_t quadCount;
+    uint32_t quadCapacity;
+};
+
+// matches the std140 matrixBuffer block of the shaders, the texture slots are packed four to a uvec4
+struct FrameUniforms {
+    float viewProjection[16];
+    uint32_t textureCount;
+    uint32_t padding[3];
+    uint32_t textureSlots[4 * 1019];
+};
+static_assert(sizeof(FrameUniforms) == 16384, "the uniform binding must fit the minimum maxUniformBufferRange");
 
 const std::set<std::string>& getRequestedLayerNames() {
     static std::set<std::string> layers;
@@ -162,6 +229,25 @@ void getAvailableVulkanExtensions(SDL_Window* window, std::vector<std::string>&
     std::cout << std::endl;
 }
 
+// Without a window there is nothing for SDL to ask for, only the debug report extension if the loader has it.
+void getHeadlessVulkanExtensions(std::vector<std::string>& outExtensions) {
+    unsigned int extensionCount = 0;
+    if (VK_SUCCESS != vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr)) {
+        throw std::runtime_error("unable to query vulkan instance extension count");
+    }
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    if (VK_SUCCESS != vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data())) {
+        throw std::runtime_error("unable to retrieve vulkan instance extension names");
+    }
+
+    for (const auto& extension : extensions) {
+        if (std::string(extension.extensionName) == VK_EXT_DEBUG_REPORT_EXTENSION_NAME) {
+            outExtensions.emplace_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+        }
+    }
+}
+
 void createVulkanInstance(const std::vector<std::string>& layerNameStrings, const std::vector<std::string>& extensionNameStrings, VkInstance& outInstance) {
     // Copy layers
     std::vector<const char*> layerNames;
@@ -185,7 +271,12 @@ void createVulkanInstance(const std::vector<std::string>& layerNameStrings, cons
     appInfo.applicationVersion = 1;
     appInfo.pEngineName = engineName;
     appInfo.engineVersion = 1;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // descriptor indexing queries features through vkGetPhysicalDeviceFeatures2, core in 1.1
+    if (bindlessTextures && api_version < VK_API_VERSION_1_1) {
+        std::cout << "bindless textures need a Vulkan 1.1 instance, sampling one texture instead" << std::endl;
+        bindlessTextures = false;
+    }
+    appInfo.apiVersion = bindlessTextures ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
 
     // initialize the VkInstanceCreateInfo structure
     VkInstanceCreateInfo instanceInfo = {};
@@ -211,7 +302,15 @@ void createVulkanInstance(const std::vector<std::string>& layerNameStrings, cons
     throw std::runtime_error("unable to create Vulkan instance: unknown error");
 }
 
-void selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& outQueueFamilyIndex) {
+// Queue families the renderer submits to.  transfer and compute are the graphics family when the device has no
+// family dedicated to them, so comparing with graphics tells whether ownership transfers are needed.
+struct QueueFamilies {
+    uint32_t graphics; // graphics and compute, rendering and presentation
+    uint32_t transfer; // copies only, where uploads run
+    uint32_t compute; // compute without graphics, for async compute
+};
+
+void selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, QueueFamilies& outQueueFamilies) {
     // Get number of available physical devices, needs to be at least 1
     unsigned int physicalDeviceCount = 0;
     vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr);
@@ -235,7 +334,12 @@ void selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
 
     // Select one if more than 1 is available
     unsigned int selectionId = 0;
-    if (physicalDeviceCount > 1)  {
+    if (gpuSelection >= 0) {
+        if ((unsigned int)gpuSelection >= physicalDeviceCount) {
+            throw std::runtime_error("--gpu index is out of range");
+        }
+        selectionId = gpuSelection;
+    } else if (physicalDeviceCount > 1 && headlessFrames == 0)  { // never block on stdin when running headless
         while (true) {
             std::cout << "select device: ";
             std::cin  >> selectionId;
@@ -276,12 +380,37 @@ void selectGPU(VkInstance instance, VkPhysicalDevice& outDevice, unsigned int& o
         throw std::runtime_error("Unable to find a queue command family that accepts graphics commands");
     }
 
+    // Dedicated families are usually separate engines, such as copy (DMA) engines, that run beside the graphics one.
+    // A transfer family is only useful if it can copy images of any size, so its granularity must be one texel.
+    QueueFamilies families = { (uint32_t)queueNodeIndex, (uint32_t)queueNodeIndex, (uint32_t)queueNodeIndex };
+    for (unsigned int i = 0; i < familyQueueCount; i++) {
+        VkQueueFlags flags = queueProperties[i].queueFlags;
+        VkExtent3D granularity = queueProperties[i].minImageTransferGranularity;
+        if (queueProperties[i].queueCount == 0) {
+            continue;
+        }
+        if (families.transfer == families.graphics && (flags & VK_QUEUE_TRANSFER_BIT)
+        && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+        && granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+            families.transfer = i;
+        }
+        if (families.compute == families.graphics && (flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            families.compute = i;
+        }
+    }
+    if (singleQueue) {
+        families.transfer = families.graphics;
+    }
+    std::cout << "queue families: graphics " << families.graphics << ", transfer " << families.transfer << ", compute " << families.compute << std::endl;
+
     // Set the output variables
     outDevice = selectedDevice;
-    outQueueFamilyIndex = queueNodeIndex;
+    outQueueFamilies = families;
 }
 
-VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, unsigned int queueFamilyIndex, const std::vector<std::string>& layerNameStrings) {
+// bindless enables descriptor indexing for the texture table, TextureTable::isSupported must have said yes
+VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, const QueueFamilies& queueFamilies, const std::vector<std::string>& layerNameStrings, bool presenting,
+        bool bindless) {
     // Copy layer names
     std::vector<const char*> layerNames;
     for (const auto& layer : layerNameStrings) {
@@ -303,7 +432,13 @@ VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, unsigned int queu
 
     // Match names against requested extension
     std::vector<const char*> devicePropertyNames;
-    const std::set<std::string> requiredExtensionNames{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::set<std::string> requiredExtensionNames;
+    if (presenting) {
+        requiredExtensionNames.insert(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    if (bindless) {
+        requiredExtensionNames.insert(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    }
     int count = 0;
     for (const auto& extensionProperty : extensionProperties) {
         std::cout << count << ": " << extensionProperty.extensionName << std::endl;
@@ -325,15 +460,20 @@ VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, unsigned int queu
     }
 
     // Create queue information structure used by device based on the previously fetched queue information from the physical device
-    // We create one command processing queue for graphics
-    VkDeviceQueueCreateInfo queueCreateInfo;
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-    queueCreateInfo.queueCount = 1;
+    // We create one command processing queue per distinct family: graphics, and transfer and compute when they are dedicated
+    std::set<uint32_t> familyIndices { queueFamilies.graphics, queueFamilies.transfer, queueFamilies.compute };
     std::vector<float> queue_prio = { 1.0f };
-    queueCreateInfo.pQueuePriorities = queue_prio.data();
-    queueCreateInfo.pNext = NULL;
-    queueCreateInfo.flags = 0;
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (uint32_t familyIndex : familyIndices) {
+        VkDeviceQueueCreateInfo queueCreateInfo;
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = familyIndex;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = queue_prio.data();
+        queueCreateInfo.pNext = NULL;
+        queueCreateInfo.flags = 0;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
 
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE; // required for aniostropic filtering, the sampler must have anisotropy enabled too
@@ -341,8 +481,8 @@ VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, unsigned int queu
     // Device creation information
     VkDeviceCreateInfo deviceCreateInfo;
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+    deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
     deviceCreateInfo.ppEnabledLayerNames = layerNames.data();
     deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(layerNames.size());
     deviceCreateInfo.ppEnabledExtensionNames = devicePropertyNames.data();
@@ -352,6 +492,11 @@ VkDevice createLogicalDevice(VkPhysicalDevice& physicalDevice, unsigned int queu
     deviceCreateInfo.flags = 0;
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = TextureTable::requiredFeatures();
+    if (bindless) {
+        deviceCreateInfo.pNext = &indexingFeatures;
+    }
+
     // Finally we're ready to create a new device
     VkDevice device;
     if (VK_SUCCESS != vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device)) {
@@ -464,20 +609,6 @@ VkSurfaceTransformFlagBitsKHR getSurfaceTransform(const VkSurfaceCapabilitiesKHR
     return capabilities.currentTransform;
 }
 
-uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        // Check if this memory type is included in memoryTypeBits (bitwise AND)
-        if ((memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
 bool getSurfaceFormat(VkPhysicalDevice device, VkSurfaceKHR surface, VkSurfaceFormatKHR& outFormat) {
     unsigned int count(0);
     if (vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &count, nullptr) != VK_SUCCESS) {
@@ -525,15 +656,25 @@ bool getSurfaceFormat(VkPhysicalDevice device, VkSurfaceKHR surface, VkSurfaceFo
     return true;
 }
 
-std::tuple<VkBuffer, VkDeviceMemory> createBuffer(VkPhysicalDevice gpu, VkDevice device, VkBufferUsageFlags usageFlags, size_t byteCount) {
+// Buffer in memory picked by its usage.  Every usage but GpuOnly is host visible and already mapped at allocation.mapped.
+// More than one queueFamilies shares the buffer between them without ownership transfers.  Given a pool, for buffers
+// of one size made over and over, the memory is a fixed size slot of *pool instead; a null *pool is created from the
+// first buffer's requirements, with poolSlotsPerBlock slots in each of its blocks.
+std::tuple<VkBuffer, Allocation> createBuffer(GpuAllocator & allocator, VkDevice device, VkBufferUsageFlags usageFlags, size_t byteCount, MemoryUsage memoryUsage,
+        AllocationStrategy strategy = AllocationStrategy::General, const std::vector<uint32_t> & queueFamilies = {},
+        MemoryPool ** pool = nullptr, uint32_t poolSlotsPerBlock = 8) {
     VkBuffer buffer;
-    VkDeviceMemory memory;
 
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = byteCount;
     bufferInfo.usage = usageFlags;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Not shared across multiple queue families
+    if (queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = queueFamilies.size();
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
 
     if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create vertex buffer!");
@@ -542,149 +683,18 @@ std::tuple<VkBuffer, VkDeviceMemory> createBuffer(VkPhysicalDevice gpu, VkDevice
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(gpu, memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
-
-    vkBindBufferMemory(device, buffer, memory, 0);
-
-    return std::make_tuple(buffer, memory);
-}
-
-// a helper to start and end a command buffer which can be submitted and waited
-struct ScopedCommandBuffer {
-    VkDevice device;
-    VkCommandPool commandPool;
-    VkQueue graphicsQueue;
-    VkCommandBuffer commandBuffer;
-    ScopedCommandBuffer(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue) : device(device), commandPool(commandPool), graphicsQueue(graphicsQueue) {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
-
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer");
-        }
-    }
-    void submitAndWait() {
-        if (VK_SUCCESS != vkEndCommandBuffer(commandBuffer)) {
-            throw std::runtime_error("failed to end command buffer");
-        }
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-
-        if (VK_SUCCESS != vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)) {
-            throw std::runtime_error("failed submit queue");
+    Allocation allocation;
+    if (pool) {
+        if (!*pool) {
+            *pool = allocator.createPool(memRequirements, memoryUsage, poolSlotsPerBlock);
         }
-        if (VK_SUCCESS != vkQueueWaitIdle(graphicsQueue)) {
-            throw std::runtime_error("failed wait for queue to be idle");
-        }
-    }
-    ~ScopedCommandBuffer() {
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-    }
-};
-
-void transitionImageLayout(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkImage image, VkFormat format, size_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    ScopedCommandBuffer scopedCommandBuffer(device, commandPool, graphicsQueue);
-
-    VkImageMemoryBarrier barrier = {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        allocation = allocator.allocateFromPool(*pool, memRequirements);
     } else {
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        allocation = allocator.allocate(memRequirements, memoryUsage, ResourceTiling::Linear, strategy);
     }
+    allocator.bindBuffer(buffer, allocation);
 
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = mipLevels;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    } else {
-        throw std::invalid_argument("unsupported layout transition!");
-    }
-
-    std::cout << "transitioning image from " << oldLayout << " to " << newLayout << std::endl;
-
-    vkCmdPipelineBarrier(
-        scopedCommandBuffer.commandBuffer,
-        sourceStage, destinationStage,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    scopedCommandBuffer.submitAndWait();
-}
-
-void copyBufferToImage(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    ScopedCommandBuffer scopedCommandBuffer(device, commandPool, graphicsQueue);
-
-    VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {
-        width,
-        height,
-        1
-    };
-
-    vkCmdCopyBufferToImage(scopedCommandBuffer.commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    scopedCommandBuffer.submitAndWait();
+    return std::make_tuple(buffer, allocation);
 }
 
 VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags imageAspects, size_t mipLevelCount) {
@@ -707,195 +717,9 @@ VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkI
     return textureImageView;
 }
 
-void generateMipmaps(VkDevice device, VkImage image, VkCommandPool commandPool, VkQueue graphicsQueue, int width, int height, size_t mipLevelCount) {
-    VkImageMemoryBarrier writeToReadBarrier = {};
-    writeToReadBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    writeToReadBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    writeToReadBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    writeToReadBarrier.image = image;
-    writeToReadBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    writeToReadBarrier.subresourceRange.baseArrayLayer = 0;
-    writeToReadBarrier.subresourceRange.layerCount = 1;
-    writeToReadBarrier.subresourceRange.levelCount = 1;
-    writeToReadBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    writeToReadBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    writeToReadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    writeToReadBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-    VkImageMemoryBarrier undefinedToWriteBarrier = writeToReadBarrier;
-    undefinedToWriteBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    undefinedToWriteBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    undefinedToWriteBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    undefinedToWriteBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    VkImageMemoryBarrier readToSampleBarrier = writeToReadBarrier;
-    readToSampleBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    readToSampleBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    readToSampleBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    readToSampleBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    VkImageBlit blit{}; // blit configuration shared for all mip levels
-    blit.srcOffsets[0] = { 0, 0, 0 };
-    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.srcSubresource.baseArrayLayer = 0;
-    blit.srcSubresource.layerCount = 1;
-    blit.dstOffsets[0] = { 0, 0, 0 };
-    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.dstSubresource.baseArrayLayer = 0;
-    blit.dstSubresource.layerCount = 1;
-
-    ScopedCommandBuffer scopedCommandBuffer(device, commandPool, graphicsQueue);
-
-    int mipWidth = width;
-    int mipHeight = height;
-    
-    for (size_t i=1; i<mipLevelCount; i++) {
-        undefinedToWriteBarrier.subresourceRange.baseMipLevel = i;
-        writeToReadBarrier.subresourceRange.baseMipLevel = i - 1;
-        readToSampleBarrier.subresourceRange.baseMipLevel = i - 1;
-
-        blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-        blit.srcSubresource.mipLevel = i - 1;
-        blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-        blit.dstSubresource.mipLevel = i;
-
-        // this mip undefined -> dest
-        vkCmdPipelineBarrier(scopedCommandBuffer.commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-            0, nullptr,
-            0, nullptr,
-            1, &undefinedToWriteBarrier);
-
-        // previous mip write -> read
-        vkCmdPipelineBarrier(scopedCommandBuffer.commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-            0, nullptr,
-            0, nullptr,
-            1, &writeToReadBarrier);
-        
-        vkCmdBlitImage(scopedCommandBuffer.commandBuffer,
-            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &blit,
-            VK_FILTER_LINEAR);
-
-        // previous mip read -> sample
-        vkCmdPipelineBarrier(scopedCommandBuffer.commandBuffer,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-            0, nullptr,
-            0, nullptr,
-            1, &readToSampleBarrier);
-        
-        if (mipWidth > 1) mipWidth /= 2;
-        if (mipHeight > 1) mipHeight /= 2;
-    }
-
-    // transition the final mip to shader read
-    VkImageMemoryBarrier writeToSampleBarrier = readToSampleBarrier;
-    writeToSampleBarrier.subresourceRange.baseMipLevel = mipLevelCount - 1;
-    writeToSampleBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    writeToSampleBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-
-    vkCmdPipelineBarrier(scopedCommandBuffer.commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-        0, nullptr,
-        0, nullptr,
-        1, &writeToSampleBarrier);
-
-    scopedCommandBuffer.submitAndWait();
-}
-
-std::tuple<VkImage, VkDeviceMemory, VkImageView> createImageFromTGAFile(const char * filename, VkPhysicalDevice gpu, VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue) {
-    VkImage image;
-    VkDeviceMemory memory;
-
-    std::ifstream file(filename);
-    std::vector<char> fileBytes = readFileBytes(file);
-    file.close();
-    unsigned width, height;
-    int bpp;
-    void* tgaBytes = read_tga(fileBytes, width, height, bpp);
-    if (tgaBytes == nullptr) {
-        throw std::runtime_error("failed to read file as TGA");
-    }
-
-    unsigned tgaByteCount = width*height*(bpp/8);
-
-    // TGA is BGR order, not RGB
-    // Further, TGA does not specify linear or non-linear color component intensity.
-    // By convention, TGA values are going to be "gamma corrected" or non-linear.
-    // Assuming the bytes are sRGB looks good.  If they are assumed to be linear here, the colors will be washed out.
-    // Read more by looking up sRGB to linear Vulkan conversions.
-    VkFormat format = (bpp == 32) ? VK_FORMAT_B8G8R8A8_SRGB : VK_FORMAT_B8G8R8_SRGB;
-
-    // put the image bytes into a buffer for transitioning
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingMemory;
-    std::tie(stagingBuffer, stagingMemory) = createBuffer(gpu, device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, tgaByteCount);
-
-    void * stagingBytes;
-    vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &stagingBytes);
-    memcpy(stagingBytes, tgaBytes, (size_t)tgaByteCount);
-    vkUnmapMemory(device, stagingMemory);
-    free(tgaBytes);
-
-    size_t mipLevels = std::floor(log2(std::max(width, height))) + 1;
-
-    VkImageCreateInfo imageInfo = {};
-    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.extent.width = width;
-    imageInfo.extent.height = height;
-    imageInfo.extent.depth = 1;
-    imageInfo.mipLevels = mipLevels;
-    imageInfo.arrayLayers = 1;
-    imageInfo.format = format;
-    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // we must "transition" this image to a device-optimal format
-
-    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT // copy bytes from image into mip levels
-        | VK_IMAGE_USAGE_TRANSFER_DST_BIT // copy bytes into image
-        | VK_IMAGE_USAGE_SAMPLED_BIT; // read by sampler in shader
-
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create Vulkan image");
-    }
-
-    VkMemoryRequirements memoryRequirements = {};
-    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memoryRequirements.size;
-    allocateInfo.memoryTypeIndex = findMemoryType(gpu, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    if (vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory");
-    }
-    vkBindImageMemory(device, image, memory, 0);
-
-    // Vulkan spec says images MUST be created either undefined or preinitialized layout, so we can't jump straight to DST_OPTIMAL.
-    transitionImageLayout(device, commandPool, graphicsQueue, image, format, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    // Now the image is in DST_OPTIMAL layout and we can copy the image data to it.
-    copyBufferToImage(device, commandPool, graphicsQueue, stagingBuffer, image, width, height);
-
-    generateMipmaps(device, image, commandPool, graphicsQueue, width, height, mipLevels);
-
-    vkFreeMemory(device, stagingMemory, nullptr);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-
-    VkImageView imageView = createImageView(device, image, format, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
-
-    return std::make_tuple(image, memory, imageView);
-}
-
+// Pass the current swap chain in outSwapChain to recreate it.  The old one is retired rather than destroyed, since
+// frames still in flight may be presenting its images: the caller destroys it once those frames have finished.
 void createSwapChain(VkSurfaceKHR surface, VkPhysicalDevice physicalDevice, VkDevice device, VkSwapchainKHR& outSwapChain) {
-    vkDeviceWaitIdle(device);
-
     // Get the surface capabilities
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     if(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities) != VK_SUCCESS) {
@@ -958,19 +782,13 @@ void createSwapChain(VkSurfaceKHR surface, VkPhysicalDevice physicalDevice, VkDe
     swapInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapInfo.presentMode = presentation_mode;
     swapInfo.clipped = true;
-    swapInfo.oldSwapchain = NULL;
+    swapInfo.oldSwapchain = oldSwapChain; // lets the driver hand over resources and keep presenting while we rebuild
     swapInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 
     // Create a new one
     if (VK_SUCCESS != vkCreateSwapchainKHR(device, &swapInfo, nullptr, &outSwapChain)) {
         throw std::runtime_error("unable to create swap chain");
     }
-
-    // Destroy old swap chain
-    if (oldSwapChain != VK_NULL_HANDLE) {
-        vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
-        oldSwapChain = VK_NULL_HANDLE;
-    }
 }
 
 void getSwapChainImageHandles(VkDevice device, VkSwapchainKHR chain, std::vector<VkImage>& outImageHandles) {
@@ -986,7 +804,9 @@ void getSwapChainImageHandles(VkDevice device, VkSwapchainKHR chain, std::vector
     }
 }
 
-std::tuple<VkImageView, VkImage, VkDeviceMemory> createDepthBuffer(VkPhysicalDevice gpu, VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue) {
+// The render pass clears depth from UNDEFINED every frame, so the new image needs no transition and creating one
+// never waits on the queue.
+std::tuple<VkImageView, VkImage, Allocation> createDepthBuffer(VkPhysicalDevice gpu, GpuAllocator & allocator, VkDevice device) {
     VkFormatProperties props;
     vkGetPhysicalDeviceFormatProperties(gpu, depthFormat, &props);
     if (0 == (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
@@ -1005,7 +825,7 @@ std::tuple<VkImageView, VkImage, VkDeviceMemory> createDepthBuffer(VkPhysicalDev
     imageInfo.arrayLayers = 1;
     imageInfo.format = depthFormat;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // we must "transition" this image to a device-optimal format
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
@@ -1023,26 +843,52 @@ std::tuple<VkImageView, VkImage, VkDeviceMemory> createDepthBuffer(VkPhysicalDev
     VkMemoryRequirements memoryRequirements;
     vkGetImageMemoryRequirements(device, image, &memoryRequirements);
 
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memoryRequirements.size;
-    allocateInfo.memoryTypeIndex = findMemoryType(gpu, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    Allocation allocation = allocator.allocate(memoryRequirements, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+    allocator.bindImage(image, allocation);
+    
+    // image view must be after binding image memory.  Moving this above bind will not cause a validation failure.
+    VkImageView imageView = createImageView(device, image, depthFormat, imageAspects, oneMipLevel);
 
-    VkDeviceMemory memory;
-    if (VK_SUCCESS != vkAllocateMemory(device, &allocateInfo, nullptr, &memory)) {
-        throw std::runtime_error("failed to allocate depth buffer memory");
-    }
+    return std::make_tuple(imageView, image, allocation);
+}
 
-    if (VK_SUCCESS != vkBindImageMemory(device, image, memory, 0)) {
-        throw std::runtime_error("failed to bind depth image memory");
+// Stands in for the swap chain when running headless.  The render pass starts it from UNDEFINED every frame, so no transition is needed.
+std::tuple<VkImageView, VkImage, Allocation> createOffscreenColorTarget(GpuAllocator & allocator, VkDevice device) {
+    pipelineInfo.w = windowWidth;
+    pipelineInfo.h = windowHeight;
+    pipelineInfo.extent.width = windowWidth;
+    pipelineInfo.extent.height = windowHeight;
+    pipelineInfo.colorFormat = surfaceFormat;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = pipelineInfo.extent.width;
+    imageInfo.extent.height = pipelineInfo.extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = pipelineInfo.colorFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // transfer source so frames can be read back
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create offscreen color image");
     }
-    
-    // image view must be after binding image memory.  Moving this above bind will not cause a validation failure, but will fail to await the queue later.
-    VkImageView imageView = createImageView(device, image, depthFormat, imageAspects, oneMipLevel);
 
-    transitionImageLayout(device, commandPool, graphicsQueue, image, depthFormat, oneMipLevel, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
 
-    return std::make_tuple(imageView, image, memory);
+    Allocation allocation = allocator.allocate(memoryRequirements, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+    allocator.bindImage(image, allocation);
+
+    VkImageView imageView = createImageView(device, image, pipelineInfo.colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+    return std::make_tuple(imageView, image, allocation);
 }
 
 void makeChainImageViews(VkDevice device, VkSwapchainKHR swapChain, std::vector<VkImage> & images, std::vector<VkImageView> & imageViews) {
@@ -1139,11 +985,17 @@ VkShaderModule createShaderModule(VkDevice device, const std::vector<char>& code
     return shaderModule;
 }
 
-VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout) {
+// textureTableLayout is set 1 with bindless textures, VK_NULL_HANDLE leaves set 0 alone
+VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout descriptorSetLayout, VkDescriptorSetLayout textureTableLayout) {
+    VkDescriptorSetLayout setLayouts[] = { descriptorSetLayout, textureTableLayout };
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;  
-    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.setLayoutCount = textureTableLayout != VK_NULL_HANDLE ? 2 : 1;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+
+    VkPushConstantRange quadRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(QuadPushConstants) };
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &quadRange;
 
     VkPipelineLayout pipelineLayout;
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
@@ -1153,7 +1005,8 @@ VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout des
     return pipelineLayout;
 }
 
-VkRenderPass createRenderPass(VkDevice device) {
+// finalLayout is PRESENT_SRC_KHR for swap chain images, which needs the swapchain extension
+VkRenderPass createRenderPass(VkDevice device, VkImageLayout colorFinalLayout) {
     VkAttachmentDescription colorAttachment = {};
     colorAttachment.format = pipelineInfo.colorFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1162,7 +1015,7 @@ VkRenderPass createRenderPass(VkDevice device) {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = colorFinalLayout;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
@@ -1175,7 +1028,7 @@ VkRenderPass createRenderPass(VkDevice device) {
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL; // should already be in this format
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // cleared every frame, the old contents are never needed
     depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference depthAttachmentRef{};
@@ -1215,12 +1068,23 @@ VkRenderPass createRenderPass(VkDevice device) {
     return renderPass;
 }
 
-VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineLayout pipelineLayout, VkRenderPass renderPass, VkShaderModule vertexShaderModule, VkShaderModule fragmentShaderModule) {
+VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkRenderPass renderPass, VkShaderModule vertexShaderModule, VkShaderModule fragmentShaderModule,
+        bool clipToEmitted) {
+    // clipToEmitted = constant_id 0, for direct draws over vertex storage that compute may not have filled
+    VkBool32 clip = clipToEmitted ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry clipEntry = { 0, 0, sizeof(VkBool32) };
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount = 1;
+    specialization.pMapEntries = &clipEntry;
+    specialization.dataSize = sizeof(clip);
+    specialization.pData = &clip;
+
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vertShaderStageInfo.module = vertexShaderModule;
     vertShaderStageInfo.pName = "main";
+    vertShaderStageInfo.pSpecializationInfo = &specialization;
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1233,11 +1097,11 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineLayout pipelineLayo
     // Binding description (one vec2 per vertex)
     VkVertexInputBindingDescription bindingDescription = {};
     bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(float) * 5; // vec3 pos and vec2 uv
+    bindingDescription.stride = sizeof(float) * 6; // vec3 pos, vec2 uv and the texture table slot
     bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
     // Attribute description (vec3 -> location 0 in the shader)
-    VkVertexInputAttributeDescription attributeDescriptions[2];
+    VkVertexInputAttributeDescription attributeDescriptions[3];
     attributeDescriptions[0] = {};
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
@@ -1252,12 +1116,19 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineLayout pipelineLayo
     attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
     attributeDescriptions[1].offset = sizeof(float) * 3;
 
+    // Attribute description (uint -> location 2 in the shader), the bits compute stored in a float
+    attributeDescriptions[2] = {};
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R32_UINT;
+    attributeDescriptions[2].offset = sizeof(float) * 5;
+
     // Pipeline vertex input state
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertexInputInfo.vertexBindingDescriptionCount = 1;
     vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = 2;
+    vertexInputInfo.vertexAttributeDescriptionCount = 3;
     vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -1334,24 +1205,68 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineLayout pipelineLayo
     pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;  // Not deriving from another pipeline
     pipelineCreateInfo.pDepthStencilState = &depthStencil;
     
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
     
     return pipeline;
 }
 
-VkPipeline createComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, VkShaderModule computeShaderModule) {
+// Size the dispatch for quads: one invocation per quad, workgroups along x up to the device limit and then along y.
+// Each of the regions of vertex storage is capped by maxStorageBufferRange, and all of them by maxQuadBufferBytes.
+QuadDispatch planQuadDispatch(VkPhysicalDevice gpu, size_t quads, size_t regions) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    const VkPhysicalDeviceLimits & limits = properties.limits;
+
+    QuadDispatch dispatch;
+    dispatch.workgroupSize = std::min({ preferredWorkgroupSize, limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations });
+
+    size_t groupCount = (quads + dispatch.workgroupSize - 1) / dispatch.workgroupSize;
+    dispatch.groupCountX = std::max<size_t>(1, std::min<size_t>(groupCount, limits.maxComputeWorkGroupCount[0]));
+    size_t groupCountY = (groupCount + dispatch.groupCountX - 1) / dispatch.groupCountX;
+    if (groupCountY > limits.maxComputeWorkGroupCount[1]) {
+        throw std::runtime_error("quad count is more than one dispatch can cover");
+    }
+    dispatch.groupCountY = std::max<size_t>(1, groupCountY);
+
+    size_t bytesPerQuad = sizeof(float) * 6 * 6; // 6 vertices of 6 floats each
+    size_t maxBytes = std::min<size_t>(limits.maxStorageBufferRange, maxQuadBufferBytes / regions);
+    dispatch.quadCapacity = std::min(quads, maxBytes / bytesPerQuad);
+    return dispatch;
+}
+
+// the most quads planQuadDispatch accepts, which is also what the shader's uint quad index and push constant hold
+size_t maxDispatchQuads(VkPhysicalDevice gpu) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    const VkPhysicalDeviceLimits & limits = properties.limits;
+
+    size_t workgroupSize = std::min({ preferredWorkgroupSize, limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations });
+    size_t dispatchQuads = workgroupSize * limits.maxComputeWorkGroupCount[0] * limits.maxComputeWorkGroupCount[1];
+    return std::min<size_t>(dispatchQuads, UINT32_MAX);
+}
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout pipelineLayout, VkShaderModule computeShaderModule, uint32_t workgroupSize) {
+    // local_size_x_id = 0
+    VkSpecializationMapEntry workgroupSizeEntry = { 0, 0, sizeof(uint32_t) };
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount = 1;
+    specialization.pMapEntries = &workgroupSizeEntry;
+    specialization.dataSize = sizeof(workgroupSize);
+    specialization.pData = &workgroupSize;
+
     VkComputePipelineCreateInfo pipelineInfo = {};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     pipelineInfo.stage.module = computeShaderModule;
     pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specialization;
     pipelineInfo.layout = pipelineLayout;
 
     VkPipeline computePipeline;
-    if (VK_SUCCESS != vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline)) {
+    if (VK_SUCCESS != vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &computePipeline)) {
         throw std::runtime_error("failed to create compute pipeline!");
     }
 
@@ -1363,76 +1278,111 @@ VkShaderModule loadShaderModule(VkDevice device, const std::string& filename) {
     return createShaderModule(device, code);
 }
 
-std::tuple<VkBuffer, VkDeviceMemory> createUniformbuffer(VkPhysicalDevice gpu, VkDevice device) {
-    VkBuffer uniformBuffer;
-    VkDeviceMemory uniformBufferMemory;
-
-    Camera camera;
-    camera.perspective(0.5f*M_PI, windowWidth, windowHeight, 0.1f, 100.0f);
-    camera.moveTo(1.0f, 0.0f, -0.1f).lookAt(0.0f, 0.0f, 1.0f);
-    mat16f viewProjection = camera.getViewProjection();
+// round size up to the next multiple of alignment, which must be a power of two
+VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
 
-    size_t byteCount = sizeof(float)*16; // 4x4 matrix
-    std::tie(uniformBuffer, uniformBufferMemory) = createBuffer(gpu, device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, byteCount);
+// Vertices written by vertices.comp and read by vertex fetch, and a VkDrawIndirectCommand reset every frame and
+// filled in by the compute shader with the vertices it emitted.  Compute counts into it with atomics, so both stay in
+// device memory and the command is copied out for the CPU to read.  With async compute, generation for one frame
+// overlaps the draw of another, so each buffer holds a region per frame, picked by the dynamic offsets of bindings
+// 2 and 3; otherwise there is one region, reused every frame behind barriers.
+struct VertexStorage {
+    VkBuffer vertices;
+    Allocation verticesAllocation;
+    VkBuffer indirect;
+    Allocation indirectAllocation;
+    size_t regions;
+    VkDeviceSize vertexBytes; // vertices of one region, the range of binding 2
+    VkDeviceSize vertexRegionBytes, indirectRegionBytes; // distance between regions, aligned for dynamic offsets
+
+    uint32_t vertexOffset(size_t region) const { return region * vertexRegionBytes; }
+    uint32_t indirectOffset(size_t region) const { return region * indirectRegionBytes; }
+};
 
-    void* data;
-    vkMapMemory(device, uniformBufferMemory, 0, byteCount, 0, &data);  // Map memory to CPU-accessible address
-    memcpy(data, viewProjection, (size_t)byteCount);                // Copy vertex data
-    vkUnmapMemory(device, uniformBufferMemory);                              // Unmap memory after copying
+// More than one queueFamilies shares the storage between them, for generation on a compute-only queue.  The draw
+// command buffer is the same size whatever the quad capacity, and is remade with the vertices on every quad count
+// change while retired ones wait for their frames, so it comes from indirectPool instead of the general blocks.
+VertexStorage createVertexStorage(VkPhysicalDevice gpu, GpuAllocator & allocator, MemoryPool *& indirectPool, VkDevice device, size_t quadCapacity, size_t regions,
+        const std::vector<uint32_t> & queueFamilies) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+    VertexStorage storage;
+    storage.regions = regions;
+    storage.vertexBytes = sizeof(float) * 6 * 6 * std::max<size_t>(quadCapacity, 1); // 6 vertices of 6 floats each per quad
+    storage.vertexRegionBytes = alignUp(storage.vertexBytes, alignment);
+    storage.indirectRegionBytes = alignUp(sizeof(VkDrawIndirectCommand), alignment);
+
+    std::tie(storage.vertices, storage.verticesAllocation) = createBuffer(allocator, device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        storage.vertexRegionBytes * regions, MemoryUsage::GpuOnly, AllocationStrategy::General, queueFamilies);
+
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    const uint32_t indirectSlotsPerBlock = 8; // the live one and those retired by quad count changes still in flight
+    std::tie(storage.indirect, storage.indirectAllocation) = createBuffer(allocator, device, usage,
+        storage.indirectRegionBytes * regions, MemoryUsage::GpuOnly, AllocationStrategy::General, queueFamilies, &indirectPool, indirectSlotsPerBlock);
+
+    return storage;
+}
 
-    return std::make_tuple(uniformBuffer, uniformBufferMemory);
+void retireVertexStorage(DeletionQueue & deletions, uint64_t lastUse, const VertexStorage & storage) {
+    deletions.push(lastUse, storage.vertices);
+    deletions.push(lastUse, storage.verticesAllocation);
+    deletions.push(lastUse, storage.indirect);
+    deletions.push(lastUse, storage.indirectAllocation);
 }
 
-std::tuple<VkBuffer, VkDeviceMemory> createShaderStorageBuffer(VkPhysicalDevice gpu, VkDevice device) {
+// Host copies of the draw command, for the benchmark report.  Frames in flight each copy to a slot of their own, so
+// one frame's copy never overwrites another's and the host reads the slot of the frame whose fence it waited on.
+std::tuple<VkBuffer, Allocation> createDrawReadbackBuffer(GpuAllocator & allocator, VkDevice device, size_t slots) {
     VkBuffer buffer;
-    VkDeviceMemory memory;
-
-    size_t byteCount = sizeof(float) * 5 * 6 * quadCount; // 6 vertices of 5 floats each per quad
+    Allocation allocation;
 
-    std::tie(buffer, memory) = createBuffer(gpu, device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, byteCount);
+    std::tie(buffer, allocation) = createBuffer(allocator, device, VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(VkDrawIndirectCommand) * slots, MemoryUsage::Readback);
 
-    return std::make_tuple(buffer, memory);
+    return std::make_tuple(buffer, allocation);
 }
 
-std::tuple<VkBuffer, VkDeviceMemory> createVertexBuffer(VkPhysicalDevice gpu, VkDevice device) {
+// static, so it lives in device memory and arrives through a staging upload
+std::tuple<VkBuffer, Allocation> createVertexBuffer(GpuAllocator & allocator, VkDevice device, UploadBatcher & uploads) {
     // Vulkan clip space has -1,-1 as the upper-left corner of the display and Y increases as you go down.
     // This is similar to most window system conventions and file formats.
+    // the last float is texture table slot 0, whose bits are those of 0.0f
     float vertices[] {
-        -0.5f, 0.5f, 0.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.0f, 1.0f, 0.0f,
-        -0.5f, -0.5f, 0.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f, 0.0f, 0.0f, 1.0f,
-        0.5f, 0.5f, 0.0f, 1.0f, 0.0f,
-        0.5f, -0.5f, 0.0f, 1.0f, 1.0f,
-
-        -0.5f, 0.5f, 0.2f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.2f, 1.0f, 0.0f,
-        -0.5f, -0.5f, 0.2f, 0.0f, 1.0f,
-        -0.5f, -0.5f, 0.2f, 0.0f, 1.0f,
-        0.5f, 0.5f, 0.2f, 1.0f, 0.0f,
-        0.5f, -0.5f, 0.2f, 1.0f, 1.0f,
+        -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f,
+        0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f,
+        -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f,
+        -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f,
+        0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f,
+        0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f,
+
+        -0.5f, 0.5f, 0.2f, 0.0f, 0.0f, 0.0f,
+        0.5f, 0.5f, 0.2f, 1.0f, 0.0f, 0.0f,
+        -0.5f, -0.5f, 0.2f, 0.0f, 1.0f, 0.0f,
+        -0.5f, -0.5f, 0.2f, 0.0f, 1.0f, 0.0f,
+        0.5f, 0.5f, 0.2f, 1.0f, 0.0f, 0.0f,
+        0.5f, -0.5f, 0.2f, 1.0f, 1.0f, 0.0f,
     }; 
 
     VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    Allocation vertexAllocation;
 
     size_t byteCount = sizeof(vertices);
-    std::tie(vertexBuffer, vertexBufferMemory) = createBuffer(gpu, device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, byteCount);
+    std::tie(vertexBuffer, vertexAllocation) = createBuffer(allocator, device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, byteCount, MemoryUsage::GpuOnly);
 
-    void* data;
-    vkMapMemory(device, vertexBufferMemory, 0, byteCount, 0, &data);  // Map memory to CPU-accessible address
-    memcpy(data, vertices, (size_t)byteCount);                // Copy vertex data
-    vkUnmapMemory(device, vertexBufferMemory);                              // Unmap memory after copying
+    uploads.uploadBuffer(vertexBuffer, vertices, byteCount); // ordered before any draw by the upload's final barrier
 
-    return std::make_tuple(vertexBuffer, vertexBufferMemory);
+    return std::make_tuple(vertexBuffer, vertexAllocation);
 }
 
 VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device) {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0; // match binding point in shader
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // the offset into the uniform ring comes with every bind
     uboLayoutBinding.descriptorCount = 1;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT; // compute culls quads with the same matrix
     uboLayoutBinding.pImmutableSamplers = nullptr;  // No sampler here
 
     VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
@@ -1444,16 +1394,20 @@ VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device) {
 
     VkDescriptorSetLayoutBinding ssboLayoutBinding = {};
     ssboLayoutBinding.binding = 2, // match binding point in shader
-    ssboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    ssboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, // the frame's region of vertex storage comes with every bind
     ssboLayoutBinding.descriptorCount = 1;
     ssboLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
     ssboLayoutBinding.pImmutableSamplers = nullptr;
 
-    VkDescriptorSetLayoutBinding bindings[] {uboLayoutBinding, samplerLayoutBinding, ssboLayoutBinding};
+    VkDescriptorSetLayoutBinding indirectLayoutBinding = ssboLayoutBinding;
+    indirectLayoutBinding.binding = 3; // the draw command compute writes
+    indirectLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT; // split draws clip to its vertex count
+
+    VkDescriptorSetLayoutBinding bindings[] {uboLayoutBinding, samplerLayoutBinding, ssboLayoutBinding, indirectLayoutBinding};
 
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 3;
+    layoutInfo.bindingCount = 4;
     layoutInfo.pBindings = bindings;
 
     VkDescriptorSetLayout descriptorSetLayout;
@@ -1464,24 +1418,37 @@ VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device) {
     return descriptorSetLayout;
 }
 
-std::tuple<VkDescriptorPool, VkDescriptorSet> createDescriptorSet(VkDevice device, VkDescriptorSetLayout descriptorSetLayout) {
+// Every frame in flight shares one descriptor set.  Frames differ only in where their uniforms are, which is the
+// dynamic offset of binding 0.  When a binding changes while frames are in flight, such as a streamed texture
+// becoming resident, new vertex storage for a quad count or new uniforms for a grown swap chain, a new set is
+// written and the old one freed once those frames are done.  A frame may replace the set for all three, so the pool
+// holds three sets per frame in flight on top of the current one.
+VkDescriptorPool createDescriptorPool(VkDevice device) {
+    const size_t setCount = 3 * framesInFlight + 1;
     VkDescriptorPoolSize poolSizes[3];
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = 1;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = setCount;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; // binds both VkImageView and VkSampler
-    poolSizes[1].descriptorCount = 1;
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; // compute shader storage buffer
-    poolSizes[2].descriptorCount = 1;
+    poolSizes[1].descriptorCount = setCount;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC; // compute shader vertices and indirect draw command
+    poolSizes[2].descriptorCount = setCount * 2;
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
     descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT; // replaced sets go back one at a time
     descriptorPoolCreateInfo.poolSizeCount = 3;
     descriptorPoolCreateInfo.pPoolSizes = poolSizes;
-    descriptorPoolCreateInfo.maxSets = 3;
+    descriptorPoolCreateInfo.maxSets = setCount;
 
     VkDescriptorPool descriptorPool;
-    vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &descriptorPool);
+    if (VK_SUCCESS != vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &descriptorPool)) {
+        throw std::runtime_error("failed to create descriptor pool");
+    }
+
+    return descriptorPool;
+}
 
+VkDescriptorSet allocateDescriptorSet(VkDevice device, VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout) {
     VkDescriptorSetAllocateInfo allocInfo = {};
     allocInfo.sType  = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool  = descriptorPool;
@@ -1489,23 +1456,26 @@ std::tuple<VkDescriptorPool, VkDescriptorSet> createDescriptorSet(VkDevice devic
     allocInfo.pSetLayouts = &descriptorSetLayout;
 
     VkDescriptorSet descriptorSet;
-    vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+    if (VK_SUCCESS != vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet)) {
+        throw std::runtime_error("failed to allocate descriptor set");
+    }
 
-    return std::make_tuple(descriptorPool, descriptorSet);
+    return descriptorSet;
 }
 
+// The binding covers one FrameUniforms at the start of the buffer, each bind adds its dynamic offset.
 VkWriteDescriptorSet createBufferToDescriptorSetBinding(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer uniformBuffer, VkDescriptorBufferInfo & bufferInfo) {
     bufferInfo = {};
     bufferInfo.buffer = uniformBuffer;
     bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(float)*16;
+    bufferInfo.range = sizeof(FrameUniforms);
 
     VkWriteDescriptorSet descriptorWrite = {};
     descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrite.dstSet = descriptorSet;
     descriptorWrite.dstBinding = 0; // match binding point in shader
     descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     descriptorWrite.descriptorCount = 1;
     descriptorWrite.pBufferInfo = &bufferInfo;
 
@@ -1530,18 +1500,19 @@ VkWriteDescriptorSet createSamplerToDescriptorSetBinding(VkDevice device, VkDesc
     return descriptorWrite;
 }
 
-VkWriteDescriptorSet createSsboToDescriptorSetBinding(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer shaderStorageBuffer, VkDescriptorBufferInfo & bufferInfo) {
+// the binding covers the first region, each bind adds the dynamic offset of its frame's region
+VkWriteDescriptorSet createSsboToDescriptorSetBinding(VkDevice device, VkDescriptorSet descriptorSet, uint32_t binding, VkBuffer shaderStorageBuffer, VkDeviceSize range, VkDescriptorBufferInfo & bufferInfo) {
     bufferInfo = {};
     bufferInfo.buffer = shaderStorageBuffer;
     bufferInfo.offset = 0;
-    bufferInfo.range = VK_WHOLE_SIZE;
+    bufferInfo.range = range;
 
     VkWriteDescriptorSet descriptorWrite = {};
     descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrite.dstSet = descriptorSet;
-    descriptorWrite.dstBinding = 2; // match binding point in shader
+    descriptorWrite.dstBinding = binding; // match binding point in shader
     descriptorWrite.dstArrayElement = 0;
-    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
     descriptorWrite.descriptorCount = 1;
     descriptorWrite.pBufferInfo = &bufferInfo;
 
@@ -1552,6 +1523,31 @@ void updateDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, std::ve
     vkUpdateDescriptorSets(device, writeDescrptorSets.size(), writeDescrptorSets.data(), 0, nullptr);
 }
 
+// what the descriptor set points at, kept together so a set can be written whole whenever one of them changes
+struct DescriptorBindings {
+    VkBuffer uniformBuffer;
+    VkSampler sampler;
+    VkImageView textureView;
+    VertexStorage vertexStorage;
+};
+
+// only for a set no pending frame uses
+void writeDescriptorSet(VkDevice device, VkDescriptorSet descriptorSet, const DescriptorBindings & bindings) {
+    // memory for these have to survive until updateDescriptorSet below
+    VkDescriptorBufferInfo uniformBufferInfo;
+    VkDescriptorImageInfo imageInfo;
+    VkDescriptorBufferInfo shaderStorageBufferInfo;
+    VkDescriptorBufferInfo indirectBufferInfo;
+
+    std::vector<VkWriteDescriptorSet> descriptorWriteSets;
+    descriptorWriteSets.push_back(createBufferToDescriptorSetBinding(device, descriptorSet, bindings.uniformBuffer, uniformBufferInfo));
+    descriptorWriteSets.push_back(createSamplerToDescriptorSetBinding(device, descriptorSet, bindings.sampler, bindings.textureView, imageInfo));
+    descriptorWriteSets.push_back(createSsboToDescriptorSetBinding(device, descriptorSet, 2, bindings.vertexStorage.vertices, bindings.vertexStorage.vertexBytes, shaderStorageBufferInfo));
+    descriptorWriteSets.push_back(createSsboToDescriptorSetBinding(device, descriptorSet, 3, bindings.vertexStorage.indirect, sizeof(VkDrawIndirectCommand), indirectBufferInfo));
+
+    updateDescriptorSet(device, descriptorSet, descriptorWriteSets);
+}
+
 VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamilyIndex) {
     VkCommandPool commandPool;
 
@@ -1625,6 +1621,291 @@ VkFence createFence(VkDevice device) {
     return fence;
 }
 
+// Everything one frame in flight owns.  The main loop cycles through framesInFlight of these, only waiting on a
+// frame's fence when it comes around again, so the CPU records frame N+1 while the GPU is still executing frame N.
+struct FrameContext {
+    VkCommandBuffer commandBuffer;
+    VkCommandBuffer computeCommandBuffer; // async compute only, VK_NULL_HANDLE otherwise
+    VkSemaphore verticesReady; // async compute only, signaled by the compute submit and waited by the graphics one
+    VkSemaphore imageAvailableSemaphore; // signaled by acquire, waited by this frame's submit
+    VkFence inFlightFence; // signaled when the GPU has finished this frame's submit
+    uint64_t submittedFrame; // frame number of this slot's latest submit, 0 before the first
+};
+
+// computeCommandPool is of the async compute queue's family, VK_NULL_HANDLE without async compute
+std::vector<FrameContext> createFrameContexts(VkDevice device, VkCommandPool commandPool, VkCommandPool computeCommandPool) {
+    std::vector<FrameContext> frames(framesInFlight);
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].commandBuffer = createCommandBuffer(device, commandPool);
+        frames[i].computeCommandBuffer = VK_NULL_HANDLE;
+        frames[i].verticesReady = VK_NULL_HANDLE;
+        if (computeCommandPool != VK_NULL_HANDLE) {
+            frames[i].computeCommandBuffer = createCommandBuffer(device, computeCommandPool);
+            frames[i].verticesReady = createSemaphore(device);
+        }
+        frames[i].imageAvailableSemaphore = createSemaphore(device);
+        frames[i].inFlightFence = createFence(device); // created signaled so the first wait on each frame returns immediately
+        frames[i].submittedFrame = 0;
+    }
+    return frames;
+}
+
+// Non-blocking: every frame up to the returned number has finished on the GPU.  A slot's fence is waited before
+// the slot is reused, so only a slot's latest submit can be unfinished, and only while its fence is unsignaled.
+uint64_t completedFrame(VkDevice device, const std::vector<FrameContext> & frames, uint64_t lastSubmittedFrame) {
+    uint64_t completed = lastSubmittedFrame;
+    for (const FrameContext & frame : frames) {
+        if (frame.submittedFrame != 0 && frame.submittedFrame <= completed && VK_SUCCESS != vkGetFenceStatus(device, frame.inFlightFence)) {
+            completed = frame.submittedFrame - 1;
+        }
+    }
+    return completed;
+}
+
+void destroyFrameContexts(VkDevice device, VkCommandPool commandPool, VkCommandPool computeCommandPool, std::vector<FrameContext> & frames) {
+    for (auto & frame : frames) {
+        vkFreeCommandBuffers(device, commandPool, 1, &frame.commandBuffer);
+        if (frame.computeCommandBuffer != VK_NULL_HANDLE) {
+            vkFreeCommandBuffers(device, computeCommandPool, 1, &frame.computeCommandBuffer);
+            vkDestroySemaphore(device, frame.verticesReady, nullptr);
+        }
+        vkDestroySemaphore(device, frame.imageAvailableSemaphore, nullptr);
+        vkDestroyFence(device, frame.inFlightFence, nullptr);
+    }
+    frames.clear();
+}
+
+// Presentation does not signal a fence, so a render finished semaphore can only safely be reused once its swapchain
+// image is acquired again.  That makes these per swapchain image rather than per frame in flight.
+std::vector<VkSemaphore> createRenderFinishedSemaphores(VkDevice device, size_t chainImageCount) {
+    std::vector<VkSemaphore> semaphores(chainImageCount);
+    for (auto & semaphore : semaphores) {
+        semaphore = createSemaphore(device);
+    }
+    return semaphores;
+}
+
+void destroySemaphores(VkDevice device, std::vector<VkSemaphore> & semaphores) {
+    for (VkSemaphore semaphore : semaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    semaphores.clear();
+}
+
+void parseArguments(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--frames-in-flight" && i + 1 < argc) {
+            framesInFlight = std::stoul(argv[++i]);
+            if (framesInFlight < 2 || framesInFlight > 3) {
+                throw std::runtime_error("--frames-in-flight must be 2 or 3");
+            }
+        } else if (arg == "--headless" && i + 1 < argc) {
+            headlessFrames = std::stoul(argv[++i]);
+            if (headlessFrames == 0) {
+                throw std::runtime_error("--headless needs a frame count above 0");
+            }
+        } else if (arg == "--report" && i + 1 < argc) {
+            reportFile = argv[++i];
+        } else if (arg == "--gpu" && i + 1 < argc) {
+            gpuSelection = std::stoi(argv[++i]);
+        } else if (arg == "--quads" && i + 1 < argc) {
+            quadCount = std::stoul(argv[++i]);
+            if (quadCount == 0) {
+                throw std::runtime_error("--quads needs a count above 0");
+            }
+        } else if (arg == "--sweep") {
+            quadSweep = true;
+        } else if (arg == "--pipeline-cache" && i + 1 < argc) {
+            pipelineCacheFile = argv[++i];
+        } else if (arg == "--no-pipeline-cache") {
+            pipelineCacheFile.clear();
+        } else if (arg == "--prerecord") {
+            prerecordCommands = true;
+        } else if (arg == "--bindless") {
+            bindlessTextures = true;
+        } else if (arg == "--texture" && i + 1 < argc) {
+            extraTextures.push_back(argv[++i]);
+        } else if (arg == "--drain-on-resize") {
+            drainOnResize = true;
+        } else if (arg == "--workers" && i + 1 < argc) {
+            jobWorkers = std::stoul(argv[++i]);
+            if (jobWorkers < 1) {
+                throw std::runtime_error("--workers needs at least 1");
+            }
+        } else if (arg == "--async-compute") {
+            asyncCompute = true;
+        } else if (arg == "--single-queue") {
+            singleQueue = true;
+        } else if (arg == "--blit-mips") {
+            computeMips = false;
+        } else if (arg == "--bench-mips") {
+            benchmarkMips = true;
+        } else if (arg == "--bench-tga") {
+            benchmarkTga = true;
+        } else if (arg == "--bench-jobs") {
+            benchmarkJobs = true;
+        } else if (arg == "--draws" && i + 1 < argc) {
+            drawCount = std::stoul(argv[++i]);
+            if (drawCount == 0) {
+                throw std::runtime_error("--draws needs a count above 0");
+            }
+        } else if (arg == "--record-chunks" && i + 1 < argc) {
+            recordChunks = std::stoul(argv[++i]);
+        } else if (arg == "--bench-recording") {
+            benchmarkRecording = true;
+        } else if (arg == "--render-thread") {
+            renderThread = true;
+        } else if (arg == "--gpu-profile") {
+            gpuProfile = true;
+        } else if (arg == "--gpu-profile-csv" && i + 1 < argc) {
+            gpuProfile = true;
+            gpuProfileCsv = argv[++i];
+        } else {
+            std::cout << "unknown argument: " << arg << std::endl;
+        }
+    }
+    if (quadSweep && headlessFrames == 0) {
+        throw std::runtime_error("--sweep needs --headless N for the frames per quad count");
+    }
+}
+
+// Swap textures that became resident into the descriptor set.  Frames in flight may still read the current set, so
+// it is never written; a new set is written instead and the old one freed once the last frame using it completes.
+// With an enabled texture table, each of quadTextures instead moves to a new slot holding its view, and its
+// placeholder slot is freed once lastUse completes; the slots reach the shaders through the frame uniforms.
+// Returns whether the set changed, so pre-recorded command buffers holding the old one can be invalidated.
+bool bindResidentTextures(VkDevice device, TextureStreamer & streamer, TextureId sampledTexture, VkDescriptorPool descriptorPool,
+        VkDescriptorSetLayout descriptorSetLayout, DescriptorBindings & bindings, VkDescriptorSet & descriptorSet, DeletionQueue & deletions, uint64_t lastUse,
+        TextureTable & table, const std::vector<TextureId> & quadTextures, std::vector<uint32_t> & textureSlots) {
+    bool changed = false;
+    for (TextureId texture : streamer.poll()) {
+        TextureStreamStats stats = streamer.stats();
+        std::cout << "texture " << streamer.filename(texture) << " resident " << streamer.latencyMs(texture) << "ms after request, decoded in "
+            << streamer.decodeMs(texture) << "ms, " << (stats.queued + stats.decoding + stats.decoded + stats.uploading) << " still loading" << std::endl;
+        for (size_t i = 0; table.isEnabled() && i < quadTextures.size(); i++) {
+            if (quadTextures[i] == texture) {
+                uint32_t slot = table.add(streamer.view(texture), bindings.sampler);
+                table.remove(textureSlots[i], lastUse);
+                textureSlots[i] = slot;
+            }
+        }
+        if (texture != sampledTexture) {
+            continue;
+        }
+        bindings.textureView = streamer.view(texture);
+        deletions.push(lastUse, descriptorPool, descriptorSet);
+        descriptorSet = allocateDescriptorSet(device, descriptorPool, descriptorSetLayout);
+        writeDescriptorSet(device, descriptorSet, bindings);
+        changed = true;
+    }
+    return changed;
+}
+
+// The frame's uniforms: the matrix, and the texture table slots quad i samples slot i % count of.  Only the slots
+// in use are written, the shaders never read past the count.
+uint32_t pushFrameUniforms(UniformRing & uniforms, const float viewProjection[16], const std::vector<uint32_t> & textureSlots) {
+    if (textureSlots.size() > sizeof(FrameUniforms::textureSlots) / sizeof(uint32_t)) {
+        throw std::runtime_error("too many textures for the frame uniforms");
+    }
+    uint32_t offset;
+    void * data;
+    std::tie(offset, data) = uniforms.allocate(sizeof(FrameUniforms));
+    FrameUniforms * frame = (FrameUniforms*)data;
+    memcpy(frame->viewProjection, viewProjection, sizeof(frame->viewProjection));
+    frame->textureCount = textureSlots.size();
+    memcpy(frame->textureSlots, textureSlots.data(), textureSlots.size() * sizeof(uint32_t));
+    return offset;
+}
+
+// global memory barrier, enough for buffers on a single queue
+void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Reset the region's draw command and dispatch vertex generation into the region.  Works on any queue with compute.
+void recordVertexGeneration(VkCommandBuffer commandBuffer, VkPipeline computePipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet,
+        const uint32_t dynamicOffsets[3], const VertexStorage & vertexStorage, size_t vertexRegion) {
+    // the count starts from zero and compute appends the quads that survive culling
+    VkDrawIndirectCommand emptyDraw = { 0, 1, 0, 0 };
+    vkCmdUpdateBuffer(commandBuffer, vertexStorage.indirect, vertexStorage.indirectOffset(vertexRegion), sizeof(emptyDraw), &emptyDraw);
+    recordMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 3, dynamicOffsets);
+    QuadPushConstants quads = { (uint32_t)quadCount, quadDispatch.quadCapacity };
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(quads), &quads);
+    vkCmdDispatch(commandBuffer, quadDispatch.groupCountX, quadDispatch.groupCountY, 1);
+}
+
+// Everything for the async compute queue in one command buffer, recorded every frame.  The frame's region was last
+// read by the frame that used it before, which its fence already covers, and the graphics submit waits for this
+// one's semaphore, so there are no barriers against the draw.  GPU profiling only times the graphics queue.
+void recordAsyncVertexGeneration(VkCommandBuffer commandBuffer, VkPipeline computePipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet,
+        uint32_t uniformOffset, const VertexStorage & vertexStorage, size_t vertexRegion) {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkResetCommandBuffer(commandBuffer, 0); // manually reset, otherwise implicit reset causes warnings
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin compute command buffer");
+    }
+
+    uint32_t dynamicOffsets[] = { uniformOffset, vertexStorage.vertexOffset(vertexRegion), vertexStorage.indirectOffset(vertexRegion) };
+    recordVertexGeneration(commandBuffer, computePipeline, pipelineLayout, descriptorSet, dynamicOffsets, vertexStorage, vertexRegion);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record compute command buffer!");
+    }
+}
+
+// Draws [firstDraw, endDraw) of drawCount, binding everything they use so that a secondary command buffer can record
+// any range of them on its own.  One draw of compute's vertices is indirect, with the count compute emitted.  More
+// split quadTotal quads into equal slices drawn directly, since the CPU never learns the count; the pipeline then
+// clips the vertices compute did not emit.  Draws past the last quad are left out.  textureSet is the texture
+// table's set, bound as set 1 unless it is VK_NULL_HANDLE.
+void recordDraws(VkCommandBuffer commandBuffer, VkPipeline graphicsPipeline, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet,
+        VkDescriptorSet textureSet, const uint32_t dynamicOffsets[3], VkBuffer vertexBuffer, const VertexStorage & vertexStorage, size_t vertexRegion,
+        size_t quadTotal, size_t drawCount, size_t firstDraw, size_t endDraw) {
+    // Bind the descriptor which contains the shader uniform buffer
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 3, dynamicOffsets);
+    if (textureSet != VK_NULL_HANDLE) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureSet, 0, nullptr);
+    }
+
+#ifdef COMPUTE_VERTICES
+    VkDeviceSize offsets[] = { vertexStorage.vertexOffset(vertexRegion) };
+#else
+    VkDeviceSize offsets[] = { 0 };
+#endif
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);  // Bind the vertex buffer
+
+#ifdef COMPUTE_VERTICES
+    if (drawCount == 1) {
+        // as many vertices as compute emitted, without the CPU knowing the count
+        vkCmdDrawIndirect(commandBuffer, vertexStorage.indirect, vertexStorage.indirectOffset(vertexRegion), 1, sizeof(VkDrawIndirectCommand));
+        return;
+    }
+#endif
+
+    size_t quadsPerDraw = (quadTotal + drawCount - 1) / drawCount;
+    for (size_t draw = firstDraw; draw < endDraw && draw * quadsPerDraw < quadTotal; draw++) {
+        size_t firstQuad = draw * quadsPerDraw;
+        size_t quads = std::min(quadsPerDraw, quadTotal - firstQuad);
+        vkCmdDraw(commandBuffer, 6 * quads, 1, 6 * firstQuad, 0);
+    }
+}
+
+// computePipeline is VK_NULL_HANDLE when the async compute queue generates the vertices.  With recording chunks the
+// draws go to secondary command buffers of recordTarget, recorded on jobs; the target's last submit must be done.
 void recordRenderPass(
     VkPipeline computePipeline,
     VkPipeline graphicsPipeline,
@@ -1632,17 +1913,30 @@ void recordRenderPass(
     VkFramebuffer framebuffer,
     VkCommandBuffer commandBuffer,
     VkBuffer vertexBuffer,
+    const VertexStorage & vertexStorage,
+    size_t vertexRegion,
+    VkBuffer drawReadbackBuffer,
+    size_t readbackSlot,
     VkPipelineLayout pipelineLayout,
-    VkDescriptorSet descriptorSet
+    VkDescriptorSet descriptorSet,
+    VkDescriptorSet textureSet,
+    uint32_t uniformOffset,
+    GpuProfiler & profiler,
+    size_t frameSlot,
+    ParallelRecorder & recorder,
+    size_t recordTarget
 ) {
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;  // Can be resubmitted multiple times
+    // re-recorded every time its frame slot comes around, unless it is pre-recorded and replayed
+    beginInfo.flags = prerecordCommands ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
         throw std::runtime_error("failed to begin command buffer");
     }
 
+    profiler.beginFrame(commandBuffer, frameSlot);
+
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassBeginInfo.renderPass = renderPass;  // Your created render pass
@@ -1660,36 +1954,73 @@ void recordRenderPass(
     renderPassBeginInfo.clearValueCount = 2;                 // Two clear values (color and depth)
     renderPassBeginInfo.pClearValues = clearValues;
 
-    // bind and dispatch compute
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    uint32_t dynamicOffsets[] = { uniformOffset, vertexStorage.vertexOffset(vertexRegion), vertexStorage.indirectOffset(vertexRegion) };
 
-    // begin recording the render pass
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (computePipeline != VK_NULL_HANDLE) {
+        // The previous frame's draw and readback copy must be done reading the command and vertices before they are rewritten.
+        recordMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+        {
+            GpuProfileScope scope(profiler, commandBuffer, "compute");
+            recordVertexGeneration(commandBuffer, computePipeline, pipelineLayout, descriptorSet, dynamicOffsets, vertexStorage, vertexRegion);
+        }
 
-    // Bind the descriptor which contains the shader uniform buffer
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+        // the draw reads the command compute wrote, and the vertices it generated, split draws read the count in the vertex shader
+        recordMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+            VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+    }
 
-    VkDeviceSize offsets[] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);  // Bind the vertex buffer
+    // timestamps outside the render pass, so the scope covers load and store of the attachments
+    {
+        GpuProfileScope scope(profiler, commandBuffer, "render pass");
 
 #ifdef COMPUTE_VERTICES
-    size_t vertexCount = 6 * quadCount;
-#else 
-    size_t vertexCount = 6 * 2;
+        size_t quadTotal = quadDispatch.quadCapacity;
+#else
+        size_t quadTotal = 2;
 #endif
-    vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+        if (recorder.chunks() == 0) {
+            // begin recording the render pass
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordDraws(commandBuffer, graphicsPipeline, pipelineLayout, descriptorSet, textureSet, dynamicOffsets, vertexBuffer, vertexStorage, vertexRegion,
+                quadTotal, drawCount, 0, drawCount);
+        } else {
+            // secondaries inherit no state from the primary, so each binds its own
+            const std::vector<VkCommandBuffer> & secondaries = recorder.record(recordTarget, renderPass, framebuffer, prerecordCommands, drawCount,
+                [&](VkCommandBuffer secondary, size_t firstDraw, size_t endDraw) {
+                    recordDraws(secondary, graphicsPipeline, pipelineLayout, descriptorSet, textureSet, dynamicOffsets, vertexBuffer, vertexStorage, vertexRegion,
+                        quadTotal, drawCount, firstDraw, endDraw);
+                });
+            vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(commandBuffer, secondaries.size(), secondaries.data());
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
 
-    vkCmdEndRenderPass(commandBuffer);
+    // Copy the draw command out of device memory, once the host waits for the frame's fence it can read its slot.
+    // The copy also waits for earlier transfers, such as the copy of the frame that last used the slot.
+    recordMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    VkBufferCopy drawCopy = { vertexStorage.indirectOffset(vertexRegion), readbackSlot * sizeof(VkDrawIndirectCommand), sizeof(VkDrawIndirectCommand) };
+    vkCmdCopyBuffer(commandBuffer, vertexStorage.indirect, drawReadbackBuffer, 1, &drawCopy);
+    recordMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to record command buffer!");
     }
 }
 
-void submitCommandBuffer(VkQueue graphicsQueue, VkCommandBuffer commandBuffer, VkSemaphore imageAvailableSemaphore, VkSemaphore renderFinishedSemaphore) {
+// Submit without waiting.  The fence is signaled when the GPU is done with the frame, which is when its resources may be reused.
+// verticesReady is signaled by the frame's async compute submit, VK_NULL_HANDLE when the frame generates its own vertices.
+void submitCommandBuffer(VkQueue graphicsQueue, VkCommandBuffer commandBuffer, VkSemaphore imageAvailableSemaphore, VkSemaphore renderFinishedSemaphore, VkFence frameFence,
+        VkSemaphore verticesReady = VK_NULL_HANDLE) {
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -1697,23 +2028,42 @@ void submitCommandBuffer(VkQueue graphicsQueue, VkCommandBuffer commandBuffer, V
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = commandBuffers;
 
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphore};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
+    // headless frames have no swap chain image to wait for or present, so both semaphores are VK_NULL_HANDLE
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitStages;
+    if (imageAvailableSemaphore != VK_NULL_HANDLE) {
+        waitSemaphores.push_back(imageAvailableSemaphore);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    if (verticesReady != VK_NULL_HANDLE) {
+        // only the draw and the readback copy touch what compute wrote, the render pass may start clearing before
+        waitSemaphores.push_back(verticesReady);
+        waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+    submitInfo.waitSemaphoreCount = waitSemaphores.size();
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphore};
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.signalSemaphoreCount = renderFinishedSemaphore != VK_NULL_HANDLE ? 1 : 0;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameFence) != VK_SUCCESS) {
         throw std::runtime_error("failed to submit command buffer!");
     }
+}
+
+// the graphics submit of the same frame waits on verticesReady, and its fence covers this submit too
+void submitVertexGeneration(VkQueue computeQueue, VkCommandBuffer commandBuffer, VkSemaphore verticesReady) {
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &verticesReady;
 
-    VkResult result = vkQueueWaitIdle(graphicsQueue);
-    if (VK_SUCCESS != result) {
-        throw std::runtime_error("failed to wait for the graphics queue to be idle");
+    if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit compute command buffer!");
     }
 }
 
@@ -1730,7 +2080,7 @@ bool presentQueue(VkQueue presentQueue, VkSwapchainKHR & swapchain, VkSemaphore
 
     VkResult result = vkQueuePresentKHR(presentQueue, &presentInfo);
     if (result != VK_SUCCESS) {
-        if (VK_ERROR_OUT_OF_DATE_KHR == result) {
+        if (VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result) {
             return false;
         } else {
             throw std::runtime_error("failed to present swap chain image!");
@@ -1740,24 +2090,135 @@ bool presentQueue(VkQueue presentQueue, VkSwapchainKHR & swapchain, VkSemaphore
     return true;
 }
 
+// What the window's frame loop renders from, sampled by the main thread from input and simulation
+struct FrameSnapshot {
+    mat16f viewProjection;
+    size_t quadCount;
+    bool resized = false; // the window changed size since the previous snapshot, so the swap chain is recreated
+    bool quit = false;
+    std::chrono::steady_clock::time_point sampled; // when the input it reflects was polled
+};
+
+// CPU time spent in one part of the frame loop, summed over a benchmark run
+struct CpuPhase {
+    const char * name;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    void add(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+        double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+    }
+};
+
+void writeBenchmarkReport(std::ostream & out, const char * deviceName, size_t frameCount, double seconds, size_t drawnQuads, double pipelineMs, bool warmPipelineCache, const std::vector<CpuPhase> & phases, const std::vector<GpuScopeSummary> & gpuScopes) {
+    out << "{\n";
+    out << "  \"device\": \"" << deviceName << "\",\n";
+    out << "  \"width\": " << pipelineInfo.extent.width << ",\n";
+    out << "  \"height\": " << pipelineInfo.extent.height << ",\n";
+    out << "  \"quads\": " << quadCount << ",\n";
+    out << "  \"drawn_quads\": " << drawnQuads << ",\n";
+    out << "  \"workgroup_size\": " << quadDispatch.workgroupSize << ",\n";
+    out << "  \"workgroups\": [" << quadDispatch.groupCountX << ", " << quadDispatch.groupCountY << "],\n";
+    out << "  \"frames_in_flight\": " << framesInFlight << ",\n";
+    out << "  \"pipeline_ms\": " << pipelineMs << ",\n";
+    out << "  \"pipeline_cache\": \"" << (warmPipelineCache ? "warm" : "cold") << "\",\n";
+    out << "  \"frames\": " << frameCount << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"fps\": " << frameCount / seconds << ",\n";
+
+    out << "  \"cpu_ms\": {";
+    for (size_t i = 0; i < phases.size(); i++) {
+        out << (i ? ",\n" : "\n") << "    \"" << phases[i].name << "\": { \"avg\": " << phases[i].totalMs / frameCount << ", \"max\": " << phases[i].maxMs << " }";
+    }
+    out << "\n  },\n";
+
+    out << "  \"gpu_ms\": {";
+    for (size_t i = 0; i < gpuScopes.size(); i++) {
+        const GpuScopeSummary & scope = gpuScopes[i];
+        out << (i ? ",\n" : "\n") << "    \"" << scope.name << "\": { \"min\": " << scope.minMs << ", \"avg\": " << scope.avgMs
+            << ", \"p99\": " << scope.p99Ms << ", \"samples\": " << scope.samples << " }";
+    }
+    out << (gpuScopes.empty() ? "}\n" : "\n  }\n");
+    out << "}\n";
+}
+
 int main(int argc, char *argv[]) {
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
-        return -1;
+    StartupTimeline timeline; // time to first frame counts from here
+    parseArguments(argc, argv);
+
+    if (benchmarkTga) {
+        benchmarkTgaDecode(std::cout);
+        return 0;
+    }
+    if (benchmarkJobs) {
+        benchmarkJobSystem(std::cout);
+        return 0;
     }
 
-    // Create vulkan compatible window
-    SDL_Window* window = SDL_CreateWindow(appName, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN);
-    if (window == nullptr) {
-        SDL_Quit();
-        return -1;
+    // headless runs never touch SDL, so they work on machines without a display or with SDL_VIDEODRIVER=dummy
+    bool headless = headlessFrames > 0;
+    if (headless) {
+        gpuProfile = true; // the report includes GPU timestamps
     }
+    if (prerecordCommands && gpuProfile) {
+        std::cout << "gpu profiling is off with pre-recorded command buffers, its queries are reset while recording" << std::endl;
+        gpuProfile = false;
+    }
+
+    // startup steps, texture decoding and per frame recording that can run beside the main thread go here
+    JobSystem jobs(jobWorkers > 0 ? jobWorkers : JobSystem::defaultWorkerCount());
 
-    // Get available vulkan extensions, necessary for interfacing with native window
-    // SDL takes care of this call and returns, next to the default VK_KHR_surface a platform specific extension
-    // When initializing the vulkan instance these extensions have to be enabled in order to create a valid
-    // surface later on.
+    // File reads and decoding need no device, so they start now and overlap instance and device creation.
+    // Textures load on jobs while the first frames render with the placeholder.
+    TextureStreamer streamer(jobs);
+    TextureId logoTexture = streamer.request("vulkan.tga");
+    std::vector<TextureId> quadTextures { logoTexture }; // what bindless quads cycle through
+    for (const std::string & filename : extraTextures) {
+        quadTextures.push_back(streamer.request(filename));
+    }
+
+    std::vector<char> vertCode, fragCode, compCode, mipCode;
+    JobCounter shaderFilesRead;
+    auto readShader = [&](const std::string & filename, std::vector<char> & code) {
+        jobs.run([&timeline, filename, &code]() {
+            timeline.measure("read " + filename, [&]() { code = readFile(filename); });
+        }, &shaderFilesRead);
+    };
+    readShader("tri.vert.spv", vertCode);
+    readShader("tri.frag.spv", fragCode);
+    std::vector<char> bindlessFragCode;
+    if (bindlessTextures) {
+        readShader("bindless.frag.spv", bindlessFragCode); // requested, the device may still turn out not to support it
+    }
+    readShader("vertices.comp.spv", compCode);
+    readShader("mipmaps.comp.spv", mipCode);
+
+    SDL_Window* window = nullptr;
     std::vector<std::string> foundExtensions;
-    getAvailableVulkanExtensions(window, foundExtensions);
+    if (headless) {
+        getHeadlessVulkanExtensions(foundExtensions);
+    } else {
+        auto windowBegin = StartupTimeline::Clock::now();
+        if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+            return -1;
+        }
+
+        // Create vulkan compatible window
+        window = SDL_CreateWindow(appName, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, SDL_WINDOW_VULKAN | SDL_WINDOW_SHOWN);
+        if (window == nullptr) {
+            SDL_Quit();
+            return -1;
+        }
+        timeline.record("create window", windowBegin, StartupTimeline::Clock::now(), true);
+
+        // Get available vulkan extensions, necessary for interfacing with native window
+        // SDL takes care of this call and returns, next to the default VK_KHR_surface a platform specific extension
+        // When initializing the vulkan instance these extensions have to be enabled in order to create a valid
+        // surface later on.
+        getAvailableVulkanExtensions(window, foundExtensions);
+    }
 
     // Get available vulkan layer extensions, notify when not all could be found
     std::vector<std::string> foundLayers;
@@ -1769,7 +2230,7 @@ int main(int argc, char *argv[]) {
 
     // Create Vulkan Instance
     VkInstance instance;
-    createVulkanInstance(foundLayers, foundExtensions, instance);
+    timeline.measure("create instance", [&]() { createVulkanInstance(foundLayers, foundExtensions, instance); });
 
     // Vulkan messaging callback
     VkDebugReportCallbackEXT callback;
@@ -1777,27 +2238,52 @@ int main(int argc, char *argv[]) {
 
     // Select GPU after succsessful creation of a vulkan instance (jeeeej no global states anymore)
     VkPhysicalDevice gpu;
-    unsigned int graphicsQueueIndex(-1);
-    selectGPU(instance, gpu, graphicsQueueIndex);
+    QueueFamilies queueFamilies;
+    timeline.measure("select gpu", [&]() { selectGPU(instance, gpu, queueFamilies); });
+    if (bindlessTextures && !TextureTable::isSupported(gpu)) {
+        std::cout << "descriptor indexing is not supported, sampling one texture instead of bindless textures" << std::endl;
+        bindlessTextures = false;
+    }
+    unsigned int graphicsQueueIndex = queueFamilies.graphics;
 
     // Create a logical device that interfaces with the physical device
-    VkDevice device = createLogicalDevice(gpu, graphicsQueueIndex, foundLayers);
-
-    // Create the surface we want to render to, associated with the window we created before
-    // This call also checks if the created surface is compatible with the previously selected physical device and associated render queue
-    VkSurfaceKHR presentationSurface = createSurface(window, instance, gpu, graphicsQueueIndex);
+    VkDevice device;
+    timeline.measure("create device", [&]() { device = createLogicalDevice(gpu, queueFamilies, foundLayers, !headless, bindlessTextures); });
 
-    VkQueue presentationQueue = getPresentationQueue(gpu, device, graphicsQueueIndex, presentationSurface);
+    // every buffer and image gets its memory from here rather than from its own vkAllocateMemory
+    GpuAllocator allocator(gpu, device);
 
-    // swap chain with image handles and views
+    VkSurfaceKHR presentationSurface = VK_NULL_HANDLE;
+    VkQueue presentationQueue = VK_NULL_HANDLE;
     VkSwapchainKHR swapchain = VK_NULL_HANDLE; // start null as this function will also recreate an old swapchain
-    createSwapChain(presentationSurface, gpu, device, swapchain);
-
     std::vector<VkImage> chainImages;
-    getSwapChainImageHandles(device, swapchain, chainImages);
+    std::vector<VkImageView> chainImageViews;
+    Allocation offscreenAllocation; // headless only, backs the single image in chainImages
+
+    if (headless) {
+        // one offscreen image takes the place of the swap chain images
+        VkImageView offscreenView;
+        VkImage offscreenImage;
+        std::tie(offscreenView, offscreenImage, offscreenAllocation) = createOffscreenColorTarget(allocator, device);
+        chainImages.push_back(offscreenImage);
+        chainImageViews.push_back(offscreenView);
+    } else {
+        auto swapchainBegin = StartupTimeline::Clock::now();
+        // Create the surface we want to render to, associated with the window we created before
+        // This call also checks if the created surface is compatible with the previously selected physical device and associated render queue
+        presentationSurface = createSurface(window, instance, gpu, graphicsQueueIndex);
+
+        presentationQueue = getPresentationQueue(gpu, device, graphicsQueueIndex, presentationSurface);
+
+        // swap chain with image handles and views
+        createSwapChain(presentationSurface, gpu, device, swapchain);
 
-    std::vector<VkImageView> chainImageViews(chainImages.size());
-    makeChainImageViews(device, swapchain, chainImages, chainImageViews);
+        getSwapChainImageHandles(device, swapchain, chainImages);
+
+        chainImageViews.resize(chainImages.size());
+        makeChainImageViews(device, swapchain, chainImages, chainImageViews);
+        timeline.record("create swap chain", swapchainBegin, StartupTimeline::Clock::now(), true);
+    }
    
     // get the queue we want to submit the actual commands to
     VkQueue graphicsQueue;
@@ -1805,190 +2291,710 @@ int main(int argc, char *argv[]) {
 
     VkCommandPool commandPool = createCommandPool(device, graphicsQueueIndex);
 
-    // shader objects
-    VkShaderModule vertShader = loadShaderModule(device, "tri.vert.spv");
-    VkShaderModule fragShader = loadShaderModule(device, "tri.frag.spv");
-    VkShaderModule compShader = loadShaderModule(device, "vertices.comp.spv");
+    // the graphics queue and pool stand in for transfer when there is no dedicated transfer family
+    VkQueue transferQueue = graphicsQueue;
+    VkCommandPool transferCommandPool = commandPool;
+    if (queueFamilies.transfer != queueFamilies.graphics) {
+        vkGetDeviceQueue(device, queueFamilies.transfer, 0, &transferQueue);
+        transferCommandPool = createCommandPool(device, queueFamilies.transfer);
+    }
 
-    // image for sampling
-    VkDeviceMemory textureImageMemory;
-    VkImage textureImage;
-    VkImageView textureImageView;
-    std::tie(textureImage, textureImageMemory, textureImageView) = createImageFromTGAFile("vulkan.tga", gpu, device, commandPool, graphicsQueue);
+    // Async compute needs a family of its own, otherwise vertices are generated in each frame's command buffer behind barriers.
+    VkQueue computeQueue = VK_NULL_HANDLE;
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    std::vector<uint32_t> sharedFamilies; // families sharing vertex storage and uniforms, empty while only graphics uses them
+    if (asyncCompute && queueFamilies.compute == queueFamilies.graphics) {
+        std::cout << "warning: no compute-only queue family, generating vertices on the graphics queue" << std::endl;
+        asyncCompute = false;
+    }
+    if (asyncCompute) {
+        vkGetDeviceQueue(device, queueFamilies.compute, 0, &computeQueue);
+        computeCommandPool = createCommandPool(device, queueFamilies.compute);
+        sharedFamilies = { queueFamilies.graphics, queueFamilies.compute };
+    }
 
-    VkSampler textureSampler = createSampler(device);
+    // timestamp queries for each frame in flight, read back when the frame's slot comes around again
+    GpuProfiler profiler(gpu, device, graphicsQueueIndex, framesInFlight, gpuProfile);
+    if (profiler.isEnabled() && !gpuProfileCsv.empty()) {
+        profiler.openCsv(gpuProfileCsv);
+    }
 
-    // uniform buffer for our view projection matrix
-    VkBuffer uniformBuffer;
-    VkDeviceMemory uniformBufferMemory;
-    std::tie(uniformBuffer, uniformBufferMemory) = createUniformbuffer(gpu, device);
+    // shader objects, from the files read since startup
+    jobs.wait(shaderFilesRead);
+    VkShaderModule vertShader, fragShader, compShader, mipShader;
+    timeline.measure("create shader modules", [&]() {
+        vertShader = createShaderModule(device, vertCode);
+        fragShader = createShaderModule(device, bindlessTextures ? bindlessFragCode : fragCode);
+        compShader = createShaderModule(device, compCode);
+        mipShader = createShaderModule(device, mipCode);
+    });
+
+    // a warm cache turns pipeline creation into a lookup, cold creation compiles the shaders
+    PipelineCache pipelineCache(gpu, device, pipelineCacheFile);
 
-    // shader storage buffer
-    VkBuffer shaderStorageBuffer;
-    VkDeviceMemory shaderStorageBufferMemory;
-    std::tie(shaderStorageBuffer, shaderStorageBufferMemory) = createShaderStorageBuffer(gpu, device);
+    // uniforms such as the view projection matrix, allocated every frame from that frame's region of the ring.
+    // Pre-recorded command buffers keep the dynamic offsets of their swapchain image, so each image needs a region.
+    // Headless pre-recording uses one command buffer per frame slot, which the per frame regions already cover.
+    size_t uniformRegionCount = framesInFlight;
+    if (prerecordCommands && !headless) {
+        uniformRegionCount = std::max(framesInFlight, chainImages.size());
+    }
+
+    // Vertex storage and draw command.  Async compute writes a frame's region while an earlier frame draws from its
+    // own, so it needs as many regions as the uniform ring, and the region of a frame is that of its uniforms.
+    size_t vertexRegionCount = asyncCompute ? uniformRegionCount : 1;
+    quadDispatch = planQuadDispatch(gpu, quadCount, vertexRegionCount);
 
     // descriptor of uniforms, both uniform buffer and sampler
     VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(device);
-    
-    VkDescriptorPool descriptorPool;
-    VkDescriptorSet descriptorSet;
-    std::tie(descriptorPool, descriptorSet) = createDescriptorSet(device, descriptorSetLayout);
 
-    // memory for these have to survive until updateDescriptorSet below
-    VkDescriptorBufferInfo uniformBufferInfo;
-    VkDescriptorImageInfo imageInfo;
-    VkDescriptorBufferInfo shaderStorageBufferInfo;
+    // pipeline and render pass
+    // every texture quads sample with bindless textures, in one descriptor array
+    TextureTable textureTable(gpu, device, bindlessTextures);
+    VkPipelineLayout pipelineLayout = createPipelineLayout(device, descriptorSetLayout, textureTable.layout());
 
-    std::vector<VkWriteDescriptorSet> descriptorWriteSets;
-    descriptorWriteSets.push_back(createBufferToDescriptorSetBinding(device, descriptorSet, uniformBuffer, uniformBufferInfo));
-    descriptorWriteSets.push_back(createSamplerToDescriptorSetBinding(device, descriptorSet, textureSampler, textureImageView, imageInfo));
-    descriptorWriteSets.push_back(createSsboToDescriptorSetBinding(device, descriptorSet, shaderStorageBuffer, shaderStorageBufferInfo));
+    VkRenderPass renderPass = createRenderPass(device, headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
-    updateDescriptorSet(device, descriptorSet, descriptorWriteSets);
+    // Both pipelines compile on jobs, the cache is internally synchronized, while this thread uploads and creates
+    // the rest.  pipelineMs runs from here until the later of the two is done.
+#ifdef COMPUTE_VERTICES
+    bool splitDraws = drawCount > 1; // direct draws over all of vertex storage, see recordDraws
+#else
+    bool splitDraws = false;
+#endif
+    auto pipelinesBegin = std::chrono::steady_clock::now();
+    VkPipeline graphicsPipeline, computePipeline;
+    std::chrono::steady_clock::time_point graphicsPipelineEnd, computePipelineEnd;
+    JobCounter pipelinesCreated;
+    jobs.run([&]() {
+        timeline.measure("create graphics pipeline", [&]() {
+            graphicsPipeline = createGraphicsPipeline(device, pipelineCache.handle(), pipelineLayout, renderPass, vertShader, fragShader, splitDraws);
+        });
+        graphicsPipelineEnd = std::chrono::steady_clock::now();
+    }, &pipelinesCreated);
+    jobs.run([&]() {
+        timeline.measure("create compute pipeline", [&]() {
+            computePipeline = createComputePipeline(device, pipelineCache.handle(), pipelineLayout, compShader, quadDispatch.workgroupSize);
+        });
+        computePipelineEnd = std::chrono::steady_clock::now();
+    }, &pipelinesCreated);
+
+    auto generatorBegin = StartupTimeline::Clock::now();
+    MipGenerator mipGenerator(gpu, device, allocator, pipelineCache.handle(), mipShader);
+    timeline.record("create mip generator", generatorBegin, StartupTimeline::Clock::now(), true);
+    if (benchmarkMips) {
+        benchmarkMipGeneration(std::cout, gpu, device, allocator, graphicsQueue, queueFamilies.graphics, commandPool, mipGenerator);
+    }
+
+    // static buffers, the placeholder and textures decoded so far are recorded into one upload batch and submitted together
+    UploadBatcher uploads(allocator, device,
+        UploadQueue{ graphicsQueue, queueFamilies.graphics, commandPool },
+        UploadQueue{ transferQueue, queueFamilies.transfer, transferCommandPool },
+        computeMips ? &mipGenerator : nullptr);
 
-    // pipeline and render pass
-    VkPipelineLayout pipelineLayout = createPipelineLayout(device, descriptorSetLayout);
+    // vertex buffer for our vertices
+    VkBuffer vertexBuffer;
+    Allocation vertexBufferAllocation;
+    timeline.measure("upload static data", [&]() {
+        streamer.attach(allocator, device, uploads);
+        std::tie(vertexBuffer, vertexBufferAllocation) = createVertexBuffer(allocator, device, uploads);
+        streamer.submitDecoded(); // usually vulkan.tga, decoded while the device was created
+
+        // No wait needed before rendering: the batch's final barriers order sampling and vertex fetch on this queue after the upload.
+        uploads.submit();
+    });
+
+    VkSampler textureSampler = createSampler(device);
 
-    VkRenderPass renderPass = createRenderPass(device);
+    UniformRing uniforms(gpu, allocator, device, uniformRegionCount, uniformBytesPerFrame, sharedFamilies);
+
+    Camera camera;
+    camera.perspective(0.5f*M_PI, windowWidth, windowHeight, 0.1f, 100.0f);
+    camera.moveTo(1.0f, 0.0f, -0.1f).lookAt(0.0f, 0.0f, 1.0f);
+
+    MemoryPool * indirectPool = nullptr; // made with the first vertex storage, lives as long as the allocator
+    VertexStorage vertexStorage = createVertexStorage(gpu, allocator, indirectPool, device, quadDispatch.quadCapacity, vertexRegionCount, sharedFamilies);
+
+    VkBuffer drawReadbackBuffer;
+    Allocation drawReadbackAllocation;
+    std::tie(drawReadbackBuffer, drawReadbackAllocation) = createDrawReadbackBuffer(allocator, device, uniformRegionCount); // a slot per uniform region
+
+    VkDescriptorPool descriptorPool = createDescriptorPool(device);
+    DescriptorBindings descriptorBindings { uniforms.handle(), textureSampler, streamer.view(logoTexture), vertexStorage };
+    VkDescriptorSet descriptorSet = allocateDescriptorSet(device, descriptorPool, descriptorSetLayout);
+    writeDescriptorSet(device, descriptorSet, descriptorBindings);
+
+    // the table slot each of quadTextures samples, the placeholder's view until the texture is resident
+    std::vector<uint32_t> textureSlots;
+    for (size_t i = 0; textureTable.isEnabled() && i < quadTextures.size(); i++) {
+        textureSlots.push_back(textureTable.add(streamer.view(quadTextures[i]), textureSampler));
+    }
 
     // depth buffer
     VkImageView depthImageView;
     VkImage depthImage;
-    VkDeviceMemory depthMemory;
-    std::tie(depthImageView, depthImage, depthMemory) = createDepthBuffer(gpu, device, commandPool, graphicsQueue);
+    Allocation depthAllocation;
+    std::tie(depthImageView, depthImage, depthAllocation) = createDepthBuffer(gpu, allocator, device);
 
     // buffers to render to for presenting
     std::vector<VkFramebuffer> presentFramebuffers(chainImages.size());
     createFramebuffers(device, renderPass, chainImageViews, presentFramebuffers, depthImageView);
 
-    VkPipeline graphicsPipeline = createGraphicsPipeline(device, pipelineLayout, renderPass, vertShader, fragShader);
-    VkPipeline computePipeline = createComputePipeline(device, pipelineLayout, compShader);
+    timeline.measure("wait for pipelines", [&]() { jobs.wait(pipelinesCreated); });
+    double pipelineMs = std::chrono::duration<double, std::milli>(std::max(graphicsPipelineEnd, computePipelineEnd) - pipelinesBegin).count();
+    std::cout << "pipelines created in " << pipelineMs << "ms from a " << (pipelineCache.isWarm() ? "warm" : "cold") << " cache" << std::endl;
+
+    std::cout << "memory for vertices: " << allocator.describe(vertexBufferAllocation) << '\n'
+        << "memory for uniforms: " << allocator.describe(uniforms.memory()) << '\n'
+        << "memory for vertex storage: " << allocator.describe(vertexStorage.verticesAllocation) << '\n'
+        << "memory for indirect draw: " << allocator.describe(vertexStorage.indirectAllocation) << '\n'
+        << "memory for draw readback: " << allocator.describe(drawReadbackAllocation) << '\n'
+        << "memory for depth: " << allocator.describe(depthAllocation) << std::endl;
+    allocator.printStatistics(std::cout);
+
+    // command buffers and sync primitives for each frame in flight
+    std::vector<FrameContext> frames = createFrameContexts(device, commandPool, computeCommandPool);
+    PrerecordedCommands recordings(device, commandPool);
+    if (prerecordCommands) {
+        recordings.setTargetCount(headless ? frames.size() : chainImages.size());
+    }
+    // secondaries belong to the same targets as the primaries that execute them
+    ParallelRecorder recorder(device, queueFamilies.graphics, jobs, recordChunks);
+    recorder.setTargetCount(prerecordCommands && !headless ? chainImages.size() : frames.size());
+    std::vector<VkSemaphore> renderFinishedSemaphores = createRenderFinishedSemaphores(device, headless ? 0 : chainImages.size());
+    size_t frameIndex = 0;
+    uint64_t lastSubmittedFrame = 0; // frames are numbered from 1 as they are submitted
+
+    // objects replaced while frames in flight may still use them, destroyed once those frames are done
+    DeletionQueue deletions(device, allocator);
 
-    // vertex buffer for our vertices
-    VkBuffer vertexBuffer;
-    VkDeviceMemory deviceMemory;
-    std::tie(vertexBuffer, deviceMemory) = createVertexBuffer(gpu, device);
+#ifdef COMPUTE_VERTICES
+    VkBuffer drawnVertexBuffer = vertexStorage.vertices;
+#else
+    VkBuffer drawnVertexBuffer = vertexBuffer;
+#endif
 
-    // command buffers for drawing
-    std::vector<VkCommandBuffer> commandBuffers(chainImages.size());
-    for (auto & commandBuffer : commandBuffers) {
-        commandBuffer = createCommandBuffer(device, commandPool);
+    if (benchmarkRecording) {
+        // one quad per draw so that none is left out, nothing is submitted so which vertices does not matter
+        uint32_t dynamicOffsets[] = { 0, vertexStorage.vertexOffset(0), vertexStorage.indirectOffset(0) };
+        benchmarkCommandRecording(std::cout, device, queueFamilies.graphics, commandPool, renderPass, presentFramebuffers[0], pipelineInfo.extent,
+            [&](VkCommandBuffer commandBuffer, size_t draws, size_t firstDraw, size_t endDraw) {
+                recordDraws(commandBuffer, graphicsPipeline, pipelineLayout, descriptorSet, textureTable.descriptorSet(), dynamicOffsets, drawnVertexBuffer, vertexStorage, 0,
+                    draws, draws, firstDraw, endDraw);
+            });
+    }
+
+    // Rebuild vertex storage for a new quad count without waiting for frames in flight.  They keep the old storage
+    // and the descriptor set pointing at it, both freed once the last of them completes; later frames get a new set.
+    auto setQuadCount = [&](size_t quads) {
+        quadCount = quads;
+        quadDispatch = planQuadDispatch(gpu, quadCount, vertexRegionCount);
+
+        retireVertexStorage(deletions, lastSubmittedFrame, vertexStorage);
+        vertexStorage = createVertexStorage(gpu, allocator, indirectPool, device, quadDispatch.quadCapacity, vertexRegionCount, sharedFamilies);
+        descriptorBindings.vertexStorage = vertexStorage;
+        deletions.push(lastSubmittedFrame, descriptorPool, descriptorSet);
+        descriptorSet = allocateDescriptorSet(device, descriptorPool, descriptorSetLayout);
+        writeDescriptorSet(device, descriptorSet, descriptorBindings);
+#ifdef COMPUTE_VERTICES
+        drawnVertexBuffer = vertexStorage.vertices;
+#endif
+        profiler.clearHistory();
+        recordings.invalidate(); // new vertex buffer and quad count
+    };
+
+    // The first submit closes the startup timeline.  Decoding ran on a job, so the streamer adds its span.
+    auto logStartup = [&]() {
+        if (timeline.isPrinted()) {
+            return;
+        }
+        bool decoded;
+        std::chrono::steady_clock::time_point decodeBegin, decodeEnd;
+        std::tie(decoded, decodeBegin, decodeEnd) = streamer.decodeSpan(logoTexture);
+        if (decoded) {
+            timeline.record("decode " + streamer.filename(logoTexture), decodeBegin, decodeEnd, false);
+        }
+        timeline.printFirstFrame(std::cout);
+    };
+
+    if (headless) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(gpu, &properties);
+
+        std::ofstream report(reportFile);
+        if (!report) {
+            throw std::runtime_error("failed to open benchmark report " + reportFile);
+        }
+
+        // benchmark frames should sample the real texture, so wait for streaming to finish before the first one
+        timeline.measure("wait for textures", [&]() { streamer.finish(); });
+        bindResidentTextures(device, streamer, logoTexture, descriptorPool, descriptorSetLayout, descriptorBindings, descriptorSet, deletions, lastSubmittedFrame,
+            textureTable, quadTextures, textureSlots);
+
+        // a sweep writes an array of reports, one per quad count, and rebuilds the vertex storage between them
+        std::vector<size_t> runQuadCounts { quadCount };
+        if (quadSweep) {
+            runQuadCounts = { 100, 1000, 10000, 100000, 1000000, 10000000 };
+            report << "[\n";
+        }
+
+        for (size_t run = 0; run < runQuadCounts.size(); run++) {
+            if (runQuadCounts[run] != quadCount) {
+                setQuadCount(runQuadCounts[run]); // the previous run ended idle
+            }
+
+            // Render a fixed number of frames as fast as the frame ring allows, with nothing to acquire or present.
+            // Every frame draws into the same offscreen image; the render pass's external dependency orders them on the queue.
+            std::vector<CpuPhase> phases { {"wait"}, {"record"}, {"submit"} };
+            auto start = std::chrono::steady_clock::now();
+
+            for (size_t i = 0; i < headlessFrames; i++) {
+                FrameContext & frame = frames[frameIndex];
+
+                auto waitBegin = std::chrono::steady_clock::now();
+                vkWaitForFences(device, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
+                uint64_t completed = completedFrame(device, frames, lastSubmittedFrame);
+                deletions.collect(completed);
+                textureTable.collect(completed);
+                vkResetFences(device, 1, &frame.inFlightFence);
+                // pre-recorded buffers are per frame slot here, so the fence above already covers their last submit
+                VkCommandBuffer commandBuffer = prerecordCommands ? recordings.waitForTarget(frameIndex) : frame.commandBuffer;
+
+                auto recordBegin = std::chrono::steady_clock::now();
+                mat16f viewProjection = camera.getViewProjection();
+                uniforms.beginFrame(frameIndex);
+                uint32_t uniformOffset = pushFrameUniforms(uniforms, viewProjection, textureSlots);
+                JobCounter computeRecorded;
+                if (asyncCompute) {
+                    jobs.run([&]() {
+                        recordAsyncVertexGeneration(frame.computeCommandBuffer, computePipeline, pipelineLayout, descriptorSet, uniformOffset, vertexStorage, frameIndex);
+                    }, &computeRecorded);
+                }
+                if (!prerecordCommands || recordings.isDirty(frameIndex)) {
+                    vkResetCommandBuffer(commandBuffer, 0);
+                    recordRenderPass(asyncCompute ? VK_NULL_HANDLE : computePipeline, graphicsPipeline, renderPass, presentFramebuffers[0], commandBuffer, drawnVertexBuffer,
+                        vertexStorage, asyncCompute ? frameIndex : 0, drawReadbackBuffer, frameIndex, pipelineLayout, descriptorSet, textureTable.descriptorSet(), uniformOffset, profiler, frameIndex,
+                        recorder, frameIndex);
+                    if (prerecordCommands) {
+                        recordings.markRecorded(frameIndex);
+                    }
+                }
+                jobs.wait(computeRecorded);
+
+                auto submitBegin = std::chrono::steady_clock::now();
+                frame.submittedFrame = ++lastSubmittedFrame;
+                if (asyncCompute) {
+                    submitVertexGeneration(computeQueue, frame.computeCommandBuffer, frame.verticesReady);
+                }
+                submitCommandBuffer(graphicsQueue, commandBuffer, VK_NULL_HANDLE, VK_NULL_HANDLE, frame.inFlightFence, frame.verticesReady);
+                if (prerecordCommands) {
+                    recordings.submitted(frameIndex, frame.inFlightFence);
+                }
+                auto submitEnd = std::chrono::steady_clock::now();
+                logStartup();
+
+                phases[0].add(waitBegin, recordBegin);
+                phases[1].add(recordBegin, submitBegin);
+                phases[2].add(submitBegin, submitEnd);
+
+                uploads.collect();
+                frameIndex = (frameIndex + 1) % frames.size();
+            }
+
+            vkDeviceWaitIdle(device);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            profiler.flush();
+
+            // the last frame's draw command, left by compute after culling in the slot of its frame
+            size_t lastFrameIndex = (frameIndex + frames.size() - 1) % frames.size();
+            const VkDrawIndirectCommand * lastDraw = (const VkDrawIndirectCommand*)drawReadbackAllocation.mapped + lastFrameIndex;
+            if (run > 0) {
+                report << ",\n";
+            }
+            writeBenchmarkReport(report, properties.deviceName, headlessFrames, seconds, lastDraw->vertexCount / 6, pipelineMs, pipelineCache.isWarm(), phases, profiler.summary());
+            std::cout << quadCount << " quads, " << headlessFrames << " frames in " << seconds << "s" << std::endl;
+        }
+
+        if (quadSweep) {
+            report << "]\n";
+        }
+        std::cout << "report written to " << reportFile << std::endl;
     }
 
-    // sync primitives
-    // It is a good idea to have a separate semaphore for each swapchain image, but for simplicity we use a single one.
-    VkSemaphore imageAvailableSemaphore = createSemaphore(device);
-    VkSemaphore renderFinishedSemaphore = createSemaphore(device);
-    VkFence fence = createFence(device);
-    
     uint nextImage = 0;
+    auto lastPresent = std::chrono::steady_clock::now();
+    double recreateMs = -1.0; // set by a swap chain recreate until the next present reports the hitch
+    uint32_t lastProfileReport = 0; // SDL_GetTicks counts from SDL_Init
+    uint32_t lastPacingReport = 0;
+    FramePacing pacing;
+    const char * pacingMode = renderThread ? "render thread" : "main thread";
+
+    // Render one frame to the window.  takeSnapshot is called once the frame slot is free, as late as it can be
+    // before recording, so the frame is built from the newest input.  Every Vulkan call of the window's frames is made
+    // from here, on whichever thread renders.
+    auto renderFrame = [&](const std::function<FrameSnapshot()> & takeSnapshot) {
+        // frames keep sampling the placeholder until the streamed texture is resident, then switch to a new set
+        if (bindResidentTextures(device, streamer, logoTexture, descriptorPool, descriptorSetLayout, descriptorBindings, descriptorSet, deletions, lastSubmittedFrame,
+            textureTable, quadTextures, textureSlots)) {
+            recordings.invalidate();
+        }
+        uploads.collect(); // hands staging memory of finished upload batches back to the allocator
 
-    SDL_Event event;
-    bool done = false;
-    while (!done) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                done = true;
+        if (profiler.isEnabled() && SDL_GetTicks() - lastProfileReport > 2000) {
+            profiler.report(std::cout);
+            lastProfileReport = SDL_GetTicks();
+        }
+        if (SDL_GetTicks() - lastPacingReport > 5000) {
+            pacing.report(std::cout, pacingMode);
+            lastPacingReport = SDL_GetTicks();
+        }
+
+        FrameContext & frame = frames[frameIndex];
+
+        // only block if the GPU is still working on the frame that last used this slot
+        vkWaitForFences(device, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
+
+        uint64_t completed = completedFrame(device, frames, lastSubmittedFrame);
+        deletions.collect(completed);
+        textureTable.collect(completed);
+
+        FrameSnapshot snapshot = takeSnapshot();
+        if (snapshot.quadCount != quadCount) {
+            setQuadCount(snapshot.quadCount);
+        }
+
+        // a resize recreates the swap chain right away, rather than once acquire or present finds it out of date
+        bool swapChainOutOfDate = snapshot.resized;
+        if (!swapChainOutOfDate) {
+            VkResult nextImageResult = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &nextImage);
+            if (VK_ERROR_OUT_OF_DATE_KHR == nextImageResult) {
+                swapChainOutOfDate = true;
+            } else if (nextImageResult != VK_SUCCESS && nextImageResult != VK_SUBOPTIMAL_KHR) {
+                std::cout << nextImageResult << std::endl;
+                throw std::runtime_error("vkAcquireNextImageKHR failed");
             }
         }
-        vkResetFences(device, 1, &fence);
 
-        VkResult nextImageResult = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore, fence, &nextImage);
-        if (nextImageResult != VK_SUCCESS) {
-            std::cout << nextImageResult << std::endl;
-            throw std::runtime_error("vkAcquireNextImageKHR failed");
+        if (!swapChainOutOfDate) {
+            // A pre-recorded buffer belongs to the acquired image along with its uniform ring and vertex storage
+            // regions, and may still be pending from the frame that last drew that image.
+            VkCommandBuffer commandBuffer = frame.commandBuffer;
+            size_t region = frameIndex;
+            if (prerecordCommands) {
+                commandBuffer = recordings.waitForTarget(nextImage);
+                region = nextImage;
+            }
+
+            // reset only once we know we will submit, otherwise the next wait on this fence would never return
+            vkResetFences(device, 1, &frame.inFlightFence);
+
+            uniforms.beginFrame(region);
+            uint32_t uniformOffset = pushFrameUniforms(uniforms, snapshot.viewProjection, textureSlots);
+
+            // The compute command buffer is the frame slot's, its last submit is covered by the fence waited above.
+            // It comes from its own pool, so a job can record it while this thread records the render pass.
+            JobCounter computeRecorded;
+            if (asyncCompute) {
+                jobs.run([&]() {
+                    recordAsyncVertexGeneration(frame.computeCommandBuffer, computePipeline, pipelineLayout, descriptorSet, uniformOffset, vertexStorage, region);
+                }, &computeRecorded);
+            }
+            if (!prerecordCommands || recordings.isDirty(nextImage)) {
+                vkResetCommandBuffer(commandBuffer, 0); // manually reset, otherwise implicit reset causes warnings
+                recordRenderPass(asyncCompute ? VK_NULL_HANDLE : computePipeline, graphicsPipeline, renderPass, presentFramebuffers[nextImage], commandBuffer, drawnVertexBuffer,
+                    vertexStorage, asyncCompute ? region : 0, drawReadbackBuffer, region, pipelineLayout, descriptorSet, textureTable.descriptorSet(), uniformOffset, profiler, frameIndex,
+                    recorder, prerecordCommands ? nextImage : frameIndex);
+                if (prerecordCommands) {
+                    recordings.markRecorded(nextImage);
+                }
+            }
+            jobs.wait(computeRecorded);
+            frame.submittedFrame = ++lastSubmittedFrame;
+            if (asyncCompute) {
+                submitVertexGeneration(computeQueue, frame.computeCommandBuffer, frame.verticesReady);
+            }
+            submitCommandBuffer(graphicsQueue, commandBuffer, frame.imageAvailableSemaphore, renderFinishedSemaphores[nextImage], frame.inFlightFence, frame.verticesReady);
+            pacing.submitted(snapshot.sampled, FramePacing::Clock::now());
+            if (prerecordCommands) {
+                recordings.submitted(nextImage, frame.inFlightFence);
+            }
+            swapChainOutOfDate = !presentQueue(presentationQueue, swapchain, renderFinishedSemaphores[nextImage], nextImage);
+            logStartup();
+
+            // the hitch is the gap between the last present on the old swap chain and the first on the new one
+            auto presented = std::chrono::steady_clock::now();
+            pacing.presented(presented);
+            if (recreateMs >= 0.0 && !swapChainOutOfDate) {
+                double hitchMs = std::chrono::duration<double, std::milli>(presented - lastPresent).count();
+                std::cout << "resize hitch " << hitchMs << "ms between presents, recreate took " << recreateMs << "ms"
+                    << (drainOnResize ? " with the device drained" : "") << std::endl;
+                recreateMs = -1.0;
+            }
+            if (recreateMs < 0.0) {
+                lastPresent = presented;
+            }
+
+            frameIndex = (frameIndex + 1) % frames.size();
         }
 
-#ifdef COMPUTE_VERTICES
-        recordRenderPass(computePipeline, graphicsPipeline, renderPass, presentFramebuffers[nextImage], commandBuffers[nextImage], shaderStorageBuffer, pipelineLayout, descriptorSet);
-#else
-        recordRenderPass(computePipeline, graphicsPipeline, renderPass, frameBuffers[nextImage], commandBuffers[nextImage], vertexBuffer, pipelineLayout, descriptorSet);
-#endif
-        submitCommandBuffer(graphicsQueue, commandBuffers[nextImage], imageAvailableSemaphore, renderFinishedSemaphore);
-        if (!presentQueue(presentationQueue, swapchain, renderFinishedSemaphore, nextImage)) {
+        if (swapChainOutOfDate) {
             std::cout << "swap chain out of date, trying to remake" << std::endl;
+            auto recreateBegin = std::chrono::steady_clock::now();
+            pacing.restart(); // the gap to the next present is the resize hitch, not frame time
 
             // This is a common Vulkan situation handled automatically by OpenGL.
-            // We need to remake our swap chain, image views, and framebuffers.
-            vkDeviceWaitIdle(device);
+            // We need to remake our swap chain, image views, and framebuffers.  Frames in flight keep going: the old
+            // objects may be in use by any frame submitted so far, so they are destroyed once the last one is done.
+            if (drainOnResize) {
+                vkDeviceWaitIdle(device);
+            }
             for (VkFramebuffer framebuffer : presentFramebuffers) {
-                vkDestroyFramebuffer(device, framebuffer, nullptr);
+                deletions.push(lastSubmittedFrame, framebuffer);
             }
             for (VkImageView view : chainImageViews) {
-                vkDestroyImageView(device, view, nullptr);
+                deletions.push(lastSubmittedFrame, view);
             }
-            vkDestroySwapchainKHR(device, swapchain, nullptr);
-
-            vkDestroyImageView(device, depthImageView, nullptr);
-            vkDestroyImage(device, depthImage, nullptr);
-            vkFreeMemory(device, depthMemory, nullptr);
+            deletions.push(lastSubmittedFrame, depthImageView);
+            deletions.push(lastSubmittedFrame, depthImage);
+            deletions.push(lastSubmittedFrame, depthAllocation);
+            // A frame's fence covers its submit, not the present that waits on its render finished semaphore, so the
+            // last presents of the old chain may still be pending when every frame submitted so far is complete.
+            // The semaphores and the old chain wait for framesInFlight more frames, whose presents are queued behind those.
+            uint64_t lastPresentUse = lastSubmittedFrame + framesInFlight;
+            for (VkSemaphore semaphore : renderFinishedSemaphores) {
+                deletions.push(lastPresentUse, semaphore);
+            }
+            // a retired swap chain may only go after the new one is created from it
+            VkSwapchainKHR oldSwapchain = swapchain;
 
-            std::tie(depthImageView, depthImage, depthMemory) = createDepthBuffer(gpu, device, commandPool, graphicsQueue);
+            createSwapChain(presentationSurface, gpu, device, swapchain); // the current swap chain becomes oldSwapchain
+            deletions.push(lastPresentUse, oldSwapchain);
 
-            swapchain = VK_NULL_HANDLE;
-            createSwapChain(presentationSurface, gpu, device, swapchain);
+            // after the swap chain, which updates the extent the depth buffer must match
+            std::tie(depthImageView, depthImage, depthAllocation) = createDepthBuffer(gpu, allocator, device);
             getSwapChainImageHandles(device, swapchain, chainImages);
             makeChainImageViews(device, swapchain, chainImages, chainImageViews);
+            presentFramebuffers.resize(chainImages.size());
             createFramebuffers(device, renderPass, chainImageViews, presentFramebuffers, depthImageView);
+
+            renderFinishedSemaphores = createRenderFinishedSemaphores(device, chainImages.size());
+
+            // the recordings captured the old framebuffers
+            if (prerecordCommands) {
+                // Each image's recording has a region of its own, so a chain that grew past them needs new uniforms,
+                // readback slots and, with async compute, vertex storage.  Frames in flight keep the old ones.
+                if (chainImages.size() > uniforms.regions()) {
+                    uniformRegionCount = std::max(framesInFlight, chainImages.size());
+                    VkBuffer oldUniforms;
+                    Allocation oldUniformsAllocation;
+                    std::tie(oldUniforms, oldUniformsAllocation) = uniforms.resize(uniformRegionCount);
+                    deletions.push(lastSubmittedFrame, oldUniforms);
+                    deletions.push(lastSubmittedFrame, oldUniformsAllocation);
+                    descriptorBindings.uniformBuffer = uniforms.handle();
+
+                    deletions.push(lastSubmittedFrame, drawReadbackBuffer);
+                    deletions.push(lastSubmittedFrame, drawReadbackAllocation);
+                    std::tie(drawReadbackBuffer, drawReadbackAllocation) = createDrawReadbackBuffer(allocator, device, uniformRegionCount);
+
+                    if (asyncCompute) {
+                        vertexRegionCount = uniformRegionCount;
+                        indirectPool = nullptr; // the draw command grows with the regions, so it needs slots of a new size
+                        setQuadCount(quadCount); // writes a new descriptor set for the uniforms too
+                    } else {
+                        deletions.push(lastSubmittedFrame, descriptorPool, descriptorSet);
+                        descriptorSet = allocateDescriptorSet(device, descriptorPool, descriptorSetLayout);
+                        writeDescriptorSet(device, descriptorSet, descriptorBindings);
+                    }
+                }
+                recordings.invalidate();
+                recordings.setTargetCount(chainImages.size());
+                recorder.setTargetCount(chainImages.size());
+            }
+
+            // several recreates in a row, without a present between them, add up to one hitch
+            recreateMs = std::max(recreateMs, 0.0) + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recreateBegin).count();
+        }
+    };
+
+    // Main thread only: poll input and apply it to the camera and quad count, then sample the result.  Arrow keys
+    // turn the camera, = and - double and halve the quads, up to what one dispatch covers.
+    size_t simulatedQuads = quadCount;
+    const size_t quadLimit = maxDispatchQuads(gpu);
+    auto simulate = [&]() {
+        FrameSnapshot next;
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                next.quit = true;
+            } else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                next.resized = true;
+                camera.perspective(0.5f*M_PI, event.window.data1, event.window.data2, 0.1f, 100.0f);
+            } else if (event.type == SDL_KEYDOWN) {
+                const float step = 0.05f; // radians per key press or repeat
+                switch (event.key.keysym.sym) {
+                    case SDLK_LEFT: camera.rotate(-step, 0.0f); break;
+                    case SDLK_RIGHT: camera.rotate(step, 0.0f); break;
+                    case SDLK_UP: camera.rotate(0.0f, step); break;
+                    case SDLK_DOWN: camera.rotate(0.0f, -step); break;
+                    case SDLK_EQUALS: simulatedQuads = std::min(quadLimit, simulatedQuads * 2); break;
+                    case SDLK_MINUS: simulatedQuads = std::max<size_t>(1, simulatedQuads / 2); break;
+                }
+            }
+        }
+        next.viewProjection = camera.getViewProjection();
+        next.quadCount = simulatedQuads;
+        next.sampled = std::chrono::steady_clock::now();
+        return next;
+    };
+
+    if (!headless && renderThread) {
+        // The render thread renders continuously from the newest snapshot, which the main thread passes through a
+        // lock-free queue, so a slow event no longer holds up frames and a slow frame or present no longer holds up input.
+        SpscQueue<FrameSnapshot> snapshots(64);
+        FrameSnapshot current = simulate();
+        std::atomic<bool> renderStopped(false);
+        std::exception_ptr renderError;
+
+        std::thread render([&]() {
+            // every waiting snapshot is taken, the newest wins, and a resize or quit in any of them is kept
+            auto takeNewest = [&]() {
+                current.resized = false;
+                FrameSnapshot next;
+                while (snapshots.tryPop(next)) {
+                    next.resized = next.resized || current.resized;
+                    next.quit = next.quit || current.quit;
+                    current = next;
+                }
+                return current;
+            };
+            try {
+                while (!current.quit) {
+                    renderFrame(takeNewest);
+                }
+            } catch (...) {
+                renderError = std::current_exception();
+            }
+            renderStopped = true;
+        });
+
+        // A snapshot that found the queue full is merged into the next one, so its resize or quit is not lost.  The
+        // main thread ticks once per event, or every millisecond when there are none.
+        FrameSnapshot unsent;
+        bool hasUnsent = false;
+        bool quitSent = false;
+        while (!quitSent && !renderStopped) {
+            SDL_WaitEventTimeout(nullptr, 1);
+            FrameSnapshot next = simulate();
+            if (hasUnsent) {
+                next.resized = next.resized || unsent.resized;
+                next.quit = next.quit || unsent.quit;
+            }
+            hasUnsent = !snapshots.tryPush(next);
+            unsent = next;
+            quitSent = next.quit && !hasUnsent;
+        }
+        render.join();
+        if (renderError) {
+            std::rethrow_exception(renderError);
         }
-        SDL_Delay(100);
-        
-        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
-        vkResetCommandBuffer(commandBuffers[nextImage], 0); // manually reset, otherwise implicit reset causes warnings
+    } else if (!headless) {
+        // events, simulation and rendering take turns on this thread
+        FrameSnapshot current;
+        do {
+            current = simulate();
+            renderFrame([&]() { return current; });
+        } while (!current.quit);
+    }
+
+    // what frames used goes out through the deletion queue, the same as anything replaced while running
+    deletions.push(lastSubmittedFrame, vertexBuffer);
+    deletions.push(lastSubmittedFrame, vertexBufferAllocation);
+    retireVertexStorage(deletions, lastSubmittedFrame, vertexStorage);
+    deletions.push(lastSubmittedFrame, drawReadbackBuffer);
+    deletions.push(lastSubmittedFrame, drawReadbackAllocation);
+    deletions.push(lastSubmittedFrame, depthImageView);
+    deletions.push(lastSubmittedFrame, depthImage);
+    deletions.push(lastSubmittedFrame, depthAllocation);
+    deletions.push(lastSubmittedFrame, computePipeline);
+    deletions.push(lastSubmittedFrame, graphicsPipeline);
+    for (VkFramebuffer framebuffer : presentFramebuffers) {
+        deletions.push(lastSubmittedFrame, framebuffer);
+    }
+    for (VkImageView view : chainImageViews) {
+        deletions.push(lastSubmittedFrame, view);
+    }
+    if (headless) {
+        deletions.push(lastSubmittedFrame, chainImages[0]);
+        deletions.push(lastSubmittedFrame, offscreenAllocation);
+    } else {
+        deletions.push(lastSubmittedFrame, swapchain);
     }
 
-    vkQueueWaitIdle(graphicsQueue); // wait until we're done or the render finished semaphore may be in use
+    vkDeviceWaitIdle(device); // wait until every frame in flight is done or its semaphores and buffers may be in use
 
-    for (auto commandBuffer : commandBuffers) {
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    // Idle covers every submit and present, so everything queued is due, including what a swap chain recreate
+    // keyed on frames past the last one submitted.
+    deletions.collect(UINT64_MAX);
+    textureTable.collect(UINT64_MAX);
+    uniforms.destroy();
+
+    if (!headless) {
+        pacing.summary(std::cout, pacingMode);
     }
-    vkDestroyCommandPool(device, commandPool, nullptr);
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, deviceMemory, nullptr);
-    vkDestroyBuffer(device, uniformBuffer, nullptr);
-    vkFreeMemory(device, uniformBufferMemory,  nullptr);
+    TextureStreamStats streamStats = streamer.stats();
+    std::cout << streamStats.resident << " textures streamed, " << streamStats.failed << " failed, latency mean "
+        << streamStats.meanLatencyMs << "ms max " << streamStats.maxLatencyMs << "ms" << std::endl;
+    streamer.destroy();
+    jobs.destroy();
+    uploads.destroy();
+    mipGenerator.destroy();
+    pipelineCache.save();
+    pipelineCache.destroy();
+    profiler.report(std::cout);
+    profiler.destroy();
 
-    vkDestroyBuffer(device, shaderStorageBuffer, nullptr);
-    vkFreeMemory(device, shaderStorageBufferMemory, nullptr);
+    if (prerecordCommands) {
+        std::cout << recordings.recordings() << " command buffer recordings" << std::endl;
+    }
+    recordings.destroy();
+    recorder.destroy();
+    destroyFrameContexts(device, commandPool, computeCommandPool, frames);
+    destroySemaphores(device, renderFinishedSemaphores);
+    if (computeCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device, computeCommandPool, nullptr);
+    }
+    if (transferCommandPool != commandPool) {
+        vkDestroyCommandPool(device, transferCommandPool, nullptr);
+    }
+    vkDestroyCommandPool(device, commandPool, nullptr);
 
     // freeing each descriptor requires the pool have the "free" bit. Look online for use cases for individual free.
     vkResetDescriptorPool(device, descriptorPool, 0); // frees all the descriptors
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    textureTable.destroy();
 
     vkDestroySampler(device, textureSampler, nullptr);
-    vkDestroyImageView(device, textureImageView, nullptr);
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory,  nullptr);
-
-    vkDestroyImageView(device, depthImageView, nullptr);
-    vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthMemory, nullptr);
 
-    vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
-    vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-    vkDestroyFence(device, fence, nullptr);
     vkDestroyShaderModule(device, compShader, nullptr);
+    vkDestroyShaderModule(device, mipShader, nullptr);
     vkDestroyShaderModule(device, vertShader, nullptr);
     vkDestroyShaderModule(device, fragShader, nullptr);
-    vkDestroyPipeline(device, computePipeline, nullptr);
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
-    for (VkFramebuffer framebuffer : presentFramebuffers) {
-        vkDestroyFramebuffer(device, framebuffer, nullptr);
-    }
-    for (VkImageView view : chainImageViews) {
-        vkDestroyImageView(device, view, nullptr);
-    }
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
+    deletions.destroy(); // the collect above leaves nothing, but the allocator must outlive every entry
+    allocator.printStatistics(std::cout);
+    allocator.destroy();
     vkDestroyDevice(device, nullptr);
 
     destroyDebugReportCallbackEXT(instance, callback, nullptr);
-    vkDestroySurfaceKHR(instance, presentationSurface, nullptr);
+    if (!headless) {
+        vkDestroySurfaceKHR(instance, presentationSurface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
-    SDL_Quit();
+    if (!headless) {
+        SDL_Quit();
+    }
 
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "mappedfile.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const char * filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(std::string("failed to open ") + filename);
+    }
+    fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    bytes = fallback.data();
+    byteCount = fallback.size();
+}
+
+MappedFile::~MappedFile() {
+}
+
+#else
+
+MappedFile::MappedFile(const char * filename) : bytes(nullptr), byteCount(0) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("failed to open ") + filename);
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error(std::string("failed to stat ") + filename);
+    }
+    byteCount = status.st_size;
+
+    if (byteCount > 0) { // mmap rejects empty mappings
+        void * mapping = mmap(nullptr, byteCount, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error(std::string("failed to map ") + filename);
+        }
+        madvise(mapping, byteCount, MADV_SEQUENTIAL); // decoders read front to back, let the kernel read ahead
+        bytes = (const char*)mapping;
+    }
+
+    close(fd); // the mapping keeps the file open
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) {
+        munmap((void*)bytes, byteCount);
+    }
+}
+
+#endif
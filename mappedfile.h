@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A whole file mapped read-only into memory.  Pages are read by the kernel on first touch and never copied into
+// the heap, so decoding straight out of a MappedFile costs one pass over the bytes.
+class MappedFile {
+    const char * bytes;
+    size_t byteCount;
+#ifdef _WIN32
+    std::vector<char> fallback; // no mmap, the file is read into memory instead
+#endif
+
+public:
+    explicit MappedFile(const char * filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const { return bytes; }
+    size_t size() const { return byteCount; }
+};
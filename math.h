@@ -98,6 +98,140 @@ Vec3<T> lerp(const Vec3<T> & from, const Vec3<T> & to, T amount) {
 
 ////////////////// MATRIX
 
+// SSE is part of x86-64 and NEON of AArch64, AVX only when the build enables it (-mavx or -march=native)
+#if defined(__AVX__)
+#define MAT16_AVX
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#define MAT16_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#define MAT16_NEON
+#include <arm_neon.h>
+#endif
+
+// The arithmetic behind Mat16 products and in-place transforms, on column major arrays of 16.  Every product is
+// summed in the same order as the plain loops, so the vector versions for float give the same results.
+template <typename T>
+struct Mat16Kernels {
+    // out = left * right, out may be either of them
+    static void multiply(const T * left, const T * right, T * out) {
+        T final[16];
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                final[i * 4 + j] =
+                    left[j] * right[i * 4] +
+                    left[j + 4] * right[i * 4 + 1] +
+                    left[j + 8] * right[i * 4 + 2] +
+                    left[j + 12] * right[i * 4 + 3];
+            }
+        }
+        std::memcpy(out, final, sizeof(T) * 16);
+    }
+    // m = L * m for L with upper left 3x3 given as its three columns, and last row and column of the identity
+    static void linearLeft(const T * l, T * m) {
+        for (int i = 0; i < 4; i++) {
+            T * column = m + i * 4;
+            T x = column[0], y = column[1], z = column[2];
+            column[0] = l[0] * x + l[3] * y + l[6] * z;
+            column[1] = l[1] * x + l[4] * y + l[7] * z;
+            column[2] = l[2] * x + l[5] * y + l[8] * z;
+        }
+    }
+    // m = translation * m, each column moves by its w
+    static void translateLeft(T x, T y, T z, T * m) {
+        for (int i = 0; i < 4; i++) {
+            T * column = m + i * 4;
+            column[0] += x * column[3];
+            column[1] += y * column[3];
+            column[2] += z * column[3];
+        }
+    }
+    // m = scale * m, which scales the rows
+    static void scaleLeft(T x, T y, T z, T * m) {
+        for (int i = 0; i < 4; i++) {
+            T * column = m + i * 4;
+            column[0] *= x;
+            column[1] *= y;
+            column[2] *= z;
+        }
+    }
+};
+
+#if defined(MAT16_AVX) || defined(MAT16_SSE) || defined(MAT16_NEON)
+// Mat16<float> storage is 16 byte aligned, so columns are loaded and stored as whole registers
+template <>
+struct Mat16Kernels<float> {
+#if defined(MAT16_NEON)
+    typedef float32x4_t Column;
+    static Column load(const float * p) { return vld1q_f32(p); }
+    static void store(float * p, Column v) { vst1q_f32(p, v); }
+    static Column set(float x, float y, float z, float w) { float v[4] = { x, y, z, w }; return vld1q_f32(v); }
+    static Column add(Column a, Column b) { return vaddq_f32(a, b); }
+    static Column mul(Column a, Column b) { return vmulq_f32(a, b); }
+    static Column mul(Column a, float s) { return vmulq_n_f32(a, s); }
+#else
+    typedef __m128 Column;
+    static Column load(const float * p) { return _mm_load_ps(p); }
+    static void store(float * p, Column v) { _mm_store_ps(p, v); }
+    static Column set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    static Column add(Column a, Column b) { return _mm_add_ps(a, b); }
+    static Column mul(Column a, Column b) { return _mm_mul_ps(a, b); }
+    static Column mul(Column a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+#endif
+
+    static void multiply(const float * left, const float * right, float * out) {
+        Column l0 = load(left), l1 = load(left + 4), l2 = load(left + 8), l3 = load(left + 12);
+#if defined(MAT16_AVX)
+        // two columns of the result per register, every left column repeated in both halves
+        __m256 a0 = _mm256_set_m128(l0, l0), a1 = _mm256_set_m128(l1, l1), a2 = _mm256_set_m128(l2, l2), a3 = _mm256_set_m128(l3, l3);
+        __m256 r01 = _mm256_loadu_ps(right), r23 = _mm256_loadu_ps(right + 8);
+        __m256 o01 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(a0, _mm256_shuffle_ps(r01, r01, 0x00)),
+            _mm256_mul_ps(a1, _mm256_shuffle_ps(r01, r01, 0x55))),
+            _mm256_mul_ps(a2, _mm256_shuffle_ps(r01, r01, 0xaa))),
+            _mm256_mul_ps(a3, _mm256_shuffle_ps(r01, r01, 0xff)));
+        __m256 o23 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(a0, _mm256_shuffle_ps(r23, r23, 0x00)),
+            _mm256_mul_ps(a1, _mm256_shuffle_ps(r23, r23, 0x55))),
+            _mm256_mul_ps(a2, _mm256_shuffle_ps(r23, r23, 0xaa))),
+            _mm256_mul_ps(a3, _mm256_shuffle_ps(r23, r23, 0xff)));
+        _mm256_storeu_ps(out, o01);
+        _mm256_storeu_ps(out + 8, o23);
+#else
+        // every right column is read before the same output column is written, so out may alias right
+        for (int i = 0; i < 4; i++) {
+            const float * r = right + i * 4;
+            store(out + i * 4, add(add(add(mul(l0, r[0]), mul(l1, r[1])), mul(l2, r[2])), mul(l3, r[3])));
+        }
+#endif
+    }
+    static void linearLeft(const float * l, float * m) {
+        Column l0 = set(l[0], l[1], l[2], 0), l1 = set(l[3], l[4], l[5], 0), l2 = set(l[6], l[7], l[8], 0);
+        Column keepW = set(0, 0, 0, 1);
+        for (int i = 0; i < 4; i++) {
+            float * column = m + i * 4;
+            Column v = load(column);
+            store(column, add(add(add(mul(l0, column[0]), mul(l1, column[1])), mul(l2, column[2])), mul(keepW, v)));
+        }
+    }
+    static void translateLeft(float x, float y, float z, float * m) {
+        Column t = set(x, y, z, 0);
+        for (int i = 0; i < 4; i++) {
+            float * column = m + i * 4;
+            store(column, add(load(column), mul(t, column[3])));
+        }
+    }
+    static void scaleLeft(float x, float y, float z, float * m) {
+        Column s = set(x, y, z, 1);
+        for (int i = 0; i < 4; i++) {
+            store(m + i * 4, mul(load(m + i * 4), s));
+        }
+    }
+};
+#endif
+
+
 // assume column major vectors
 // elements 0, 1, 2, 3 represent first column
 // to transform a vertex:
@@ -107,15 +241,9 @@ Vec3<T> lerp(const Vec3<T> & from, const Vec3<T> & to, T amount) {
 template <typename T>
 class Mat16 {
     typedef Vec3<T> VectorType;
-    static inline void element(int i, int j, const T * left, const T * right, T * out) {
-        out[i * 4 + j] =
-            left[j] * right[i * 4] +
-            left[j + 4] * right[i * 4 + 1] +
-            left[j + 8] * right[i * 4 + 2] +
-            left[j + 12] * right[i * 4 + 3];
-    }
+    typedef Mat16Kernels<T> Kernels;
 public:
-    T c[16];
+    alignas(16) T c[16];
     void identity() {
         memset(c, 0, sizeof(T)* 16);
         c[0] = 1;
@@ -149,36 +277,17 @@ public:
         return c[i * 4 + j];
     };
     void rightMultiply(const Mat16 & m) {
-        T final[16];
-        for (size_t i = 0; i<4; i++) {
-            for (size_t j = 0; j<4; j++) {
-                element(i, j, c, m.c, final);
-            }
-        }
-        std::memcpy(c, final, sizeof(T)* 16);
+        Kernels::multiply(c, m.c, c);
     }
     void leftMultiply(const Mat16 & m) {
-        T final[16];
-        for (int i = 0; i<4; i++) {
-            for (int j = 0; j<4; j++) {
-                element(i, j, m.c, c, final);
-            }
-        }
-        std::memcpy(c, final, sizeof(T)* 16);
+        Kernels::multiply(m.c, c, c);
     }
+    // translate, scale, rotate and orient left-multiply in place, touching only the rows the transform changes
     void translate(const VectorType & v) {
-        Mat16 m;
-        m.c[12] = v.x;
-        m.c[13] = v.y;
-        m.c[14] = v.z;
-        leftMultiply(m);
+        Kernels::translateLeft(v.x, v.y, v.z, c);
     }
     void scale(const VectorType & v) {
-        Mat16 m;
-        m(0, 0) = v.x;
-        m(1, 1) = v.y;
-        m(2, 2) = v.z;
-        leftMultiply(m);
+        Kernels::scaleLeft(v.x, v.y, v.z, c);
     }
     void scale(T s) {
         scale(Vec3<T>(s, s, s));
@@ -189,8 +298,7 @@ public:
         zaxis.normalize();
         VectorType out = zaxis.cross(yaxis);
         VectorType xaxis = zaxis.cross(out);
-        Mat16 m(xaxis, zaxis, out);
-        leftMultiply(m);
+        leftMultiplyRows(xaxis, zaxis, out);
     }
     void orient(const VectorType & yaxis, const VectorType & zaxis) {
         VectorType forwardN(zaxis);
@@ -198,8 +306,7 @@ public:
         VectorType upN(yaxis);
         upN.normalize();
         VectorType xaxis = upN.cross(forwardN);
-        Mat16 m(xaxis, upN, forwardN);
-        leftMultiply(m);
+        leftMultiplyRows(xaxis, upN, forwardN);
     }
     // rotate around an arbitrary axis.  theta is in radians, so for a 90 degree rotation, pass 0.5 * M_PI
     // rotation direction is right-hand rule when thumb is given axis
@@ -210,11 +317,16 @@ public:
         x /= d;
         y /= d;
         z /= d;
-        Mat16 m;
-        m.c[0] = 1 + cost1*(x*x - 1); m.c[4] = cost1*x*y - z*sint; m.c[8] = cost1*x*z + y*sint;
-        m.c[1] = cost1*x*y + z*sint; m.c[5] = 1 + cost1*(y*y - 1); m.c[9] = cost1*y*z - x*sint;
-        m.c[2] = cost1*x*z - y*sint; m.c[6] = cost1*y*z + x*sint; m.c[10] = 1 + cost1*(z*z - 1);
-        leftMultiply(m);
+        T m[9] = {
+            1 + cost1*(x*x - 1), cost1*x*y + z*sint, cost1*x*z - y*sint,
+            cost1*x*y - z*sint, 1 + cost1*(y*y - 1), cost1*y*z + x*sint,
+            cost1*x*z + y*sint, cost1*y*z - x*sint, 1 + cost1*(z*z - 1) };
+        Kernels::linearLeft(m, c);
+    }
+    // left-multiply by the rotation whose rows are the given axes, as the lookAt constructor builds it
+    void leftMultiplyRows(const VectorType & x, const VectorType & y, const VectorType & z) {
+        T m[9] = { x.x, y.x, z.x, x.y, y.y, z.y, x.z, y.z, z.z };
+        Kernels::linearLeft(m, c);
     }
     // right multiply column vector: M * V
     void transform(VectorType & v) const {
@@ -386,9 +498,35 @@ public:
 
         return m;
     }
+    // Inverse of a matrix whose last row is 0, 0, 0, 1, such as any mix of translate, rotate and scale:
+    // the 3x3 is inverted by cofactors and the translation is moved back through it.  Far cheaper than inverted().
+    Mat16 affineInverted() const {
+        T det = c[0] * (c[5] * c[10] - c[9] * c[6]) -
+            c[4] * (c[1] * c[10] - c[9] * c[2]) +
+            c[8] * (c[1] * c[6] - c[5] * c[2]);
+
+        if (det == 0) throw std::runtime_error("cannot invert matrix; determinant is 0.");
+
+        T inverse = 1 / det;
+        Mat16 m;
+        m.c[0] = (c[5] * c[10] - c[9] * c[6]) * inverse;
+        m.c[4] = (c[8] * c[6] - c[4] * c[10]) * inverse;
+        m.c[8] = (c[4] * c[9] - c[8] * c[5]) * inverse;
+        m.c[1] = (c[9] * c[2] - c[1] * c[10]) * inverse;
+        m.c[5] = (c[0] * c[10] - c[8] * c[2]) * inverse;
+        m.c[9] = (c[8] * c[1] - c[0] * c[9]) * inverse;
+        m.c[2] = (c[1] * c[6] - c[5] * c[2]) * inverse;
+        m.c[6] = (c[4] * c[2] - c[0] * c[6]) * inverse;
+        m.c[10] = (c[0] * c[5] - c[4] * c[1]) * inverse;
+
+        m.c[12] = -(m.c[0] * c[12] + m.c[4] * c[13] + m.c[8] * c[14]);
+        m.c[13] = -(m.c[1] * c[12] + m.c[5] * c[13] + m.c[9] * c[14]);
+        m.c[14] = -(m.c[2] * c[12] + m.c[6] * c[13] + m.c[10] * c[14]);
+        return m;
+    }
     Mat16 operator*(const Mat16 & r) const {
-        Mat16 final(*this);
-        final.rightMultiply(r);
+        Mat16 final;
+        Kernels::multiply(c, r.c, final.c);
         return final;
     }
     VectorType operator*(const VectorType & v) const {
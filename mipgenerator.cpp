@@ -0,0 +1,290 @@
+#include "mipgenerator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// matches the push constants of mipmaps.comp
+struct ChainPushConstants {
+    uint32_t width, height;
+    uint32_t levelCount;
+    uint32_t srgb;
+};
+
+const uint32_t setsPerPool = 32;
+const uint32_t tileSize = 64; // level 0 texels on a side reduced by one workgroup
+
+bool isSrgb(VkFormat format) {
+    return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+void recordLevelsBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t mipLevels,
+        VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void recordCounterBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+}
+
+MipGenerator::MipGenerator(VkPhysicalDevice gpu, VkDevice device, GpuAllocator & allocator, VkPipelineCache pipelineCache, VkShaderModule shader)
+    : device(device), allocator(allocator), supported(false), setLayout(VK_NULL_HANDLE), pipelineLayout(VK_NULL_HANDLE), pipeline(VK_NULL_HANDLE), counter(VK_NULL_HANDLE) {
+    // every level is a storage image of one array, more than the four the spec guarantees per stage
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(gpu, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+    supported = properties.limits.maxPerStageDescriptorStorageImages >= maxLevels
+        && properties.limits.maxDescriptorSetStorageImages >= maxLevels
+        && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+    if (!supported) {
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = maxLevels;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 2;
+    layoutInfo.pBindings = bindings;
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout)) {
+        throw std::runtime_error("failed to create mip generator descriptor set layout");
+    }
+
+    VkPushConstantRange pushConstants = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ChainPushConstants) };
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+    if (VK_SUCCESS != vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout)) {
+        throw std::runtime_error("failed to create mip generator pipeline layout");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shader;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    if (VK_SUCCESS != vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline)) {
+        throw std::runtime_error("failed to create mip generator pipeline");
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizeof(uint32_t);
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (VK_SUCCESS != vkCreateBuffer(device, &bufferInfo, nullptr, &counter)) {
+        throw std::runtime_error("failed to create mip generator counter");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device, counter, &memoryRequirements);
+    counterAllocation = allocator.allocate(memoryRequirements, MemoryUsage::GpuOnly, ResourceTiling::Linear);
+    allocator.bindBuffer(counter, counterAllocation);
+}
+
+MipGenerator::~MipGenerator() {
+    destroy();
+}
+
+VkFormat MipGenerator::storageFormat(VkFormat sampledFormat) const {
+    if (!supported) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    // Channel order does not matter to a per channel average, so BGRA is filtered through an RGBA view too.
+    switch (sampledFormat) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+VkDescriptorSet MipGenerator::allocateSet(VkDescriptorPool & outPool) {
+    if (!pools.empty()) {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pools.back();
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayout;
+
+        VkDescriptorSet set;
+        if (VK_SUCCESS == vkAllocateDescriptorSets(device, &allocInfo, &set)) {
+            outPool = pools.back();
+            return set;
+        }
+    }
+
+    VkDescriptorPoolSize poolSizes[2];
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[0].descriptorCount = setsPerPool * maxLevels;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = setsPerPool;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT; // sets go back as their uploads complete
+    poolInfo.maxSets = setsPerPool;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+
+    VkDescriptorPool pool;
+    if (VK_SUCCESS != vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool)) {
+        throw std::runtime_error("failed to create mip generator descriptor pool");
+    }
+    pools.push_back(pool);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    VkDescriptorSet set;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(device, &allocInfo, &set)) {
+        throw std::runtime_error("failed to allocate mip generator descriptor set");
+    }
+    outPool = pool;
+    return set;
+}
+
+std::function<void()> MipGenerator::record(VkCommandBuffer commandBuffer, VkImage image, VkFormat sampledFormat, uint32_t width, uint32_t height, uint32_t mipLevels) {
+    VkFormat format = storageFormat(sampledFormat);
+    if (format == VK_FORMAT_UNDEFINED || mipLevels > maxLevels) {
+        throw std::runtime_error("mip generator cannot build this chain, blit it instead");
+    }
+
+    std::vector<VkImageView> views(mipLevels);
+    for (uint32_t level = 0; level < mipLevels; level++) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (VK_SUCCESS != vkCreateImageView(device, &viewInfo, nullptr, &views[level])) {
+            throw std::runtime_error("failed to create mip level view");
+        }
+    }
+
+    VkDescriptorPool pool;
+    VkDescriptorSet set = allocateSet(pool);
+
+    VkDescriptorImageInfo imageInfos[maxLevels];
+    for (uint32_t i = 0; i < maxLevels; i++) {
+        imageInfos[i].sampler = VK_NULL_HANDLE;
+        imageInfos[i].imageView = views[std::min(i, mipLevels - 1)];
+        imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+    VkDescriptorBufferInfo counterInfo = { counter, 0, sizeof(uint32_t) };
+
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = maxLevels;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[0].pImageInfo = imageInfos;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &counterInfo;
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+    // The counter is shared by every dispatch, so the previous one must be done with it before it is cleared.
+    recordCounterBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(commandBuffer, counter, 0, sizeof(uint32_t), 0);
+    recordCounterBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // level 0 holds the copied texels and the rest is about to be overwritten, all of it is read and written in GENERAL
+    recordLevelsBarrier(commandBuffer, image, mipLevels,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    ChainPushConstants chain = { width, height, mipLevels, isSrgb(sampledFormat) ? 1u : 0u };
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(chain), &chain);
+    vkCmdDispatch(commandBuffer, (width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, 1);
+
+    recordLevelsBarrier(commandBuffer, image, mipLevels,
+        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    VkDevice device = this->device;
+    return [=]() {
+        vkFreeDescriptorSets(device, pool, 1, &set);
+        for (VkImageView view : views) {
+            vkDestroyImageView(device, view, nullptr);
+        }
+    };
+}
+
+void MipGenerator::destroy() {
+    for (VkDescriptorPool pool : pools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    pools.clear();
+    if (pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        pipeline = VK_NULL_HANDLE;
+    }
+    if (counter != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, counter, nullptr);
+        allocator.free(counterAllocation);
+        counter = VK_NULL_HANDLE;
+    }
+    supported = false;
+}
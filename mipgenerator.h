@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "allocator.h"
+
+// Builds mip chains with mipmaps.comp, one dispatch per image instead of a blit and barriers per level.  The shader
+// writes storage views of each level, so the image is created in storageFormat with MUTABLE_FORMAT and STORAGE
+// usage and sampled through a view of its own format; sRGB is decoded and encoded in the shader, which keeps the
+// filter gamma correct even though storage views are UNORM.  Formats without a storage equivalent keep the blits.
+class MipGenerator {
+public:
+    static const uint32_t maxLevels = 16; // the descriptor array in mipmaps.comp
+
+private:
+    VkDevice device;
+    GpuAllocator & allocator;
+    bool supported;
+    VkDescriptorSetLayout setLayout;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+    VkBuffer counter; // workgroups that finished, for the last one to find out it is last
+    Allocation counterAllocation;
+    std::vector<VkDescriptorPool> pools; // a new one whenever the last is full, sets go back to the pool they came from
+
+    VkDescriptorSet allocateSet(VkDescriptorPool & outPool);
+
+public:
+    MipGenerator(VkPhysicalDevice gpu, VkDevice device, GpuAllocator & allocator, VkPipelineCache pipelineCache, VkShaderModule shader);
+    ~MipGenerator();
+
+    // the format to create an image sampled as sampledFormat in, VK_FORMAT_UNDEFINED when its mips have to be blitted
+    VkFormat storageFormat(VkFormat sampledFormat) const;
+
+    // Same contract as recordMipmaps: every level starts in TRANSFER_DST_OPTIMAL with level 0 written by a transfer,
+    // and ends in SHADER_READ_ONLY_OPTIMAL.  Needs a queue with compute.  Returns a function that frees the views
+    // and descriptor set the dispatch uses, to call once the command buffer has completed.
+    std::function<void()> record(VkCommandBuffer commandBuffer, VkImage image, VkFormat sampledFormat, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+    // call once no recorded dispatch is pending, before destroying the allocator
+    void destroy();
+};
@@ -0,0 +1,91 @@
+#include "parallelrecorder.h"
+
+#include <stdexcept>
+
+ParallelRecorder::ParallelRecorder(VkDevice device, uint32_t queueFamily, JobSystem & jobs, size_t chunkCount)
+    : device(device), queueFamily(queueFamily), jobs(jobs), chunkCount(chunkCount) {
+}
+
+ParallelRecorder::~ParallelRecorder() {
+    destroy();
+}
+
+void ParallelRecorder::setTargetCount(size_t count) {
+    while (targets.size() < count) {
+        Target target;
+        for (size_t i = 0; i < chunkCount; i++) {
+            // transient, since every record resets the pool and records the secondary anew
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = queueFamily;
+
+            VkCommandPool pool;
+            if (VK_SUCCESS != vkCreateCommandPool(device, &poolInfo, nullptr, &pool)) {
+                throw std::runtime_error("failed to create secondary command pool");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            VkCommandBuffer commandBuffer;
+            if (VK_SUCCESS != vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer)) {
+                throw std::runtime_error("failed to allocate secondary command buffer");
+            }
+            target.pools.push_back(pool);
+            target.commandBuffers.push_back(commandBuffer);
+        }
+        targets.push_back(target);
+    }
+}
+
+const std::vector<VkCommandBuffer> & ParallelRecorder::record(size_t target, VkRenderPass renderPass, VkFramebuffer framebuffer, bool reusable, size_t drawCount,
+        const std::function<void(VkCommandBuffer commandBuffer, size_t firstDraw, size_t endDraw)> & recordDraws) {
+    Target & recorded = targets[target];
+
+    JobCounter chunksRecorded;
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        size_t firstDraw = drawCount * chunk / chunkCount;
+        size_t endDraw = drawCount * (chunk + 1) / chunkCount;
+        jobs.run([&, chunk, firstDraw, endDraw]() {
+            VkCommandBuffer commandBuffer = recorded.commandBuffers[chunk];
+            vkResetCommandPool(device, recorded.pools[chunk], 0);
+
+            // the render pass and subpass the secondary runs in, and the framebuffer so the driver may specialize for it
+            VkCommandBufferInheritanceInfo inheritance = {};
+            inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.renderPass = renderPass;
+            inheritance.subpass = 0;
+            inheritance.framebuffer = framebuffer;
+
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | (reusable ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            beginInfo.pInheritanceInfo = &inheritance;
+
+            if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin secondary command buffer");
+            }
+            recordDraws(commandBuffer, firstDraw, endDraw);
+            if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer");
+            }
+        }, &chunksRecorded);
+    }
+    jobs.wait(chunksRecorded);
+
+    return recorded.commandBuffers;
+}
+
+void ParallelRecorder::destroy() {
+    // destroying a pool frees its command buffers
+    for (Target & target : targets) {
+        for (VkCommandPool pool : target.pools) {
+            vkDestroyCommandPool(device, pool, nullptr);
+        }
+    }
+    targets.clear();
+}
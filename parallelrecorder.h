@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "jobsystem.h"
+
+// Records the draws of a render pass into secondary command buffers on jobs, for the primary to execute inside a
+// render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.  Draws are split into chunkCount contiguous
+// chunks, one secondary each.  Every chunk of every target has a command pool of its own, so no two threads ever
+// record from one pool, and a pool is reset only when the target's previous primary is known to be done.
+// A target is a frame slot, or a swapchain image for pre-recorded command buffers, the same as PrerecordedCommands.
+class ParallelRecorder {
+    struct Target {
+        std::vector<VkCommandPool> pools;
+        std::vector<VkCommandBuffer> commandBuffers; // one per chunk, in draw order
+    };
+
+    VkDevice device;
+    uint32_t queueFamily;
+    JobSystem & jobs;
+    size_t chunkCount;
+    std::vector<Target> targets;
+
+public:
+    // chunkCount 0 records nothing here, the caller records its draws inline
+    ParallelRecorder(VkDevice device, uint32_t queueFamily, JobSystem & jobs, size_t chunkCount);
+    ~ParallelRecorder();
+
+    size_t chunks() const { return chunkCount; }
+
+    // Only ever grows, as command buffers of dropped targets may still be pending.
+    void setTargetCount(size_t count);
+
+    // Record draws [0, drawCount) of the target, recordDraws(commandBuffer, firstDraw, endDraw) once per chunk on a
+    // job, and return the secondaries once all are recorded.  The target's previous primary must be done; reusable
+    // leaves out ONE_TIME_SUBMIT, for primaries that are replayed.
+    const std::vector<VkCommandBuffer> & record(size_t target, VkRenderPass renderPass, VkFramebuffer framebuffer, bool reusable, size_t drawCount,
+        const std::function<void(VkCommandBuffer commandBuffer, size_t firstDraw, size_t endDraw)> & recordDraws);
+
+    // call once no primary executing the secondaries is pending
+    void destroy();
+};
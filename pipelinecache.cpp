@@ -0,0 +1,118 @@
+#include "pipelinecache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+// why the file can't be used by this device, or an empty string when it can
+std::string validatePipelineCacheData(const std::vector<char> & data, const VkPhysicalDeviceProperties & properties) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return "file is shorter than a cache header";
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size()) {
+        return "header size is invalid";
+    }
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        return "unknown header version";
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID) {
+        return "written by another device";
+    }
+    if (memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        return "written by another driver version";
+    }
+    return "";
+}
+
+PipelineCache::PipelineCache(VkPhysicalDevice gpu, VkDevice device, const std::string & filename)
+    : device(device), cache(VK_NULL_HANDLE), filename(filename), warm(false) {
+    std::vector<char> data;
+    if (!filename.empty()) {
+        std::ifstream file(filename, std::ios::binary);
+        if (file) {
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(gpu, &properties);
+
+            std::string reason = validatePipelineCacheData(data, properties);
+            if (!reason.empty()) {
+                std::cout << "pipeline cache " << filename << " rejected: " << reason << std::endl;
+                data.clear();
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    // the header only says who wrote the file, a driver may still refuse the rest, so fall back to an empty cache
+    if (VK_SUCCESS == vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache)) {
+        warm = !data.empty();
+        return;
+    }
+    if (!data.empty()) {
+        std::cout << "pipeline cache " << filename << " rejected by the driver" << std::endl;
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        if (VK_SUCCESS == vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache)) {
+            return;
+        }
+    }
+    throw std::runtime_error("failed to create pipeline cache");
+}
+
+PipelineCache::~PipelineCache() {
+    destroy();
+}
+
+void PipelineCache::save() {
+    if (filename.empty() || cache == VK_NULL_HANDLE) {
+        return;
+    }
+
+    size_t size = 0;
+    if (VK_SUCCESS != vkGetPipelineCacheData(device, cache, &size, nullptr)) {
+        throw std::runtime_error("failed to get pipeline cache size");
+    }
+    std::vector<char> data(size);
+    if (VK_SUCCESS != vkGetPipelineCacheData(device, cache, &size, data.data())) {
+        throw std::runtime_error("failed to get pipeline cache data");
+    }
+    data.resize(size);
+
+    // a failed write only costs the next run its warm start, so report it instead of throwing
+    std::string temporary = filename + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.flush();
+        if (!file) {
+            std::cout << "failed to write pipeline cache " << temporary << std::endl;
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, filename, error); // replaces the old file in one step
+    if (error) {
+        std::cout << "failed to replace pipeline cache " << filename << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+void PipelineCache::destroy() {
+    if (cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(device, cache, nullptr);
+        cache = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+// A VkPipelineCache kept in a file between runs.  The file is only handed to the driver when its header matches
+// this device (vendor ID, device ID and pipelineCacheUUID); anything short, corrupt or from another driver is
+// rejected and the cache starts empty.  save writes a temporary file and renames it over the old one, so a crash
+// or a full disk never leaves a truncated cache behind.
+class PipelineCache {
+    VkDevice device;
+    VkPipelineCache cache;
+    std::string filename;
+    bool warm;
+
+public:
+    // an empty filename keeps the cache in memory only
+    PipelineCache(VkPhysicalDevice gpu, VkDevice device, const std::string & filename);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache &) = delete;
+    PipelineCache & operator=(const PipelineCache &) = delete;
+
+    VkPipelineCache handle() const { return cache; }
+
+    // true when a valid file was loaded, so pipelines created with it should mostly skip compilation
+    bool isWarm() const { return warm; }
+
+    // write the current contents back to the file, call after creating pipelines and before destroy
+    void save();
+
+    // call before vkDestroyDevice
+    void destroy();
+};
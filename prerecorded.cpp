@@ -0,0 +1,75 @@
+#include "prerecorded.h"
+
+#include <stdexcept>
+
+PrerecordedCommands::PrerecordedCommands(VkDevice device, VkCommandPool commandPool)
+    : device(device), commandPool(commandPool), recordingCount(0) {
+}
+
+PrerecordedCommands::~PrerecordedCommands() {
+    destroy();
+}
+
+void PrerecordedCommands::freeCommandBuffers() {
+    for (Target & target : targets) {
+        vkFreeCommandBuffers(device, commandPool, 1, &target.commandBuffer);
+    }
+    targets.clear();
+}
+
+void PrerecordedCommands::setTargetCount(size_t count) {
+    while (targets.size() > count) {
+        VkCommandBuffer commandBuffer = waitForTarget(targets.size() - 1);
+        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        targets.pop_back();
+    }
+    invalidate();
+    if (count == targets.size()) {
+        return;
+    }
+
+    std::vector<VkCommandBuffer> commandBuffers(count - targets.size());
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = commandBuffers.size();
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate pre-recorded command buffers");
+    }
+
+    for (VkCommandBuffer commandBuffer : commandBuffers) {
+        targets.push_back(Target{ commandBuffer, true, VK_NULL_HANDLE });
+    }
+}
+
+void PrerecordedCommands::invalidate() {
+    for (Target & target : targets) {
+        target.dirty = true;
+    }
+}
+
+void PrerecordedCommands::invalidate(size_t target) {
+    targets[target].dirty = true;
+}
+
+VkCommandBuffer PrerecordedCommands::waitForTarget(size_t target) {
+    Target & entry = targets[target];
+    if (entry.lastSubmit != VK_NULL_HANDLE) {
+        vkWaitForFences(device, 1, &entry.lastSubmit, VK_TRUE, UINT64_MAX);
+    }
+    return entry.commandBuffer;
+}
+
+void PrerecordedCommands::markRecorded(size_t target) {
+    targets[target].dirty = false;
+    recordingCount++;
+}
+
+void PrerecordedCommands::submitted(size_t target, VkFence fence) {
+    targets[target].lastSubmit = fence;
+}
+
+void PrerecordedCommands::destroy() {
+    freeCommandBuffers();
+}
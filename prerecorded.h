@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <vector>
+
+// Command buffers recorded once per target and replayed every frame, for scenes where nothing recorded changes.
+// A target is a swapchain image, or a frame slot when rendering headless into a single image.
+// Whatever a recording captures - framebuffers, pipelines, buffers, descriptor sets, dynamic uniform offsets, push
+// constants such as the quad count - must call invalidate when it changes; the next frame that uses a dirty target
+// re-records it.
+class PrerecordedCommands {
+    struct Target {
+        VkCommandBuffer commandBuffer;
+        bool dirty;
+        VkFence lastSubmit; // fence of the latest submit of commandBuffer, VK_NULL_HANDLE before the first
+    };
+
+    VkDevice device;
+    VkCommandPool commandPool;
+    std::vector<Target> targets;
+    size_t recordingCount;
+
+    void freeCommandBuffers();
+
+public:
+    PrerecordedCommands(VkDevice device, VkCommandPool commandPool);
+    ~PrerecordedCommands();
+
+    // One command buffer per target, all dirty.  Called again after the swap chain is recreated: existing command
+    // buffers are kept, since they may still be pending, and re-recorded once waitForTarget sees their submit done.
+    // Targets dropped by a smaller count are waited for before they are freed.
+    void setTargetCount(size_t count);
+    size_t targetCount() const { return targets.size(); }
+
+    // request a re-record of every target, or of one
+    void invalidate();
+    void invalidate(size_t target);
+    bool isDirty(size_t target) const { return targets[target].dirty; }
+
+    // The target's command buffer, once its previous submit is done so it may be reset or resubmitted.
+    // When isDirty, reset and record it and then call markRecorded.
+    VkCommandBuffer waitForTarget(size_t target);
+    void markRecorded(size_t target);
+
+    // remember the fence of the submit that used the target's command buffer
+    void submitted(size_t target, VkFence fence);
+
+    // how many times any target was recorded, stays flat while nothing is invalidated
+    size_t recordings() const { return recordingCount; }
+
+    // call before destroying the command pool
+    void destroy();
+};
@@ -0,0 +1,188 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+GpuProfiler::GpuProfiler(VkPhysicalDevice gpu, VkDevice device, uint32_t queueFamilyIndex, size_t frameSlots, bool requested, uint32_t maxScopesPerFrame)
+    : device(device), enabled(false), queryPool(VK_NULL_HANDLE), maxScopesPerFrame(maxScopesPerFrame), nanosecondsPerTick(1.0), timestampMask(0),
+      slots(frameSlots), currentSlot(0), frameNumber(0) {
+    if (!requested) {
+        return;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+
+    uint32_t validBits = families[queueFamilyIndex].timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+        std::cout << "warning: queue family does not support timestamps, gpu profiling disabled\n";
+        return;
+    }
+
+    nanosecondsPerTick = properties.limits.timestampPeriod;
+    timestampMask = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+    VkQueryPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameSlots * maxScopesPerFrame * 2; // a begin and an end per scope
+
+    if (VK_SUCCESS != vkCreateQueryPool(device, &poolInfo, nullptr, &queryPool)) {
+        throw std::runtime_error("failed to create timestamp query pool");
+    }
+
+    enabled = true;
+}
+
+GpuProfiler::~GpuProfiler() {
+    destroy();
+}
+
+void GpuProfiler::openCsv(const std::string & filename) {
+    csv.open(filename);
+    if (!csv) {
+        throw std::runtime_error("failed to open gpu profile csv " + filename);
+    }
+    csv << "frame,scope,ms\n";
+}
+
+void GpuProfiler::collect(size_t slot) {
+    FrameSlot & frame = slots[slot];
+    if (frame.scopeNames.empty()) {
+        return;
+    }
+
+    // value and availability pairs, so a result that is somehow not ready is skipped instead of waited for
+    uint32_t queryCount = frame.scopeNames.size() * 2;
+    std::vector<uint64_t> results(queryCount * 2);
+    VkResult result = vkGetQueryPoolResults(device, queryPool, slot * maxScopesPerFrame * 2, queryCount,
+        results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) {
+        throw std::runtime_error("failed to read timestamp queries");
+    }
+
+    for (size_t i = 0; i < frame.scopeNames.size(); i++) {
+        uint64_t begin = results[4 * i];
+        uint64_t beginAvailable = results[4 * i + 1];
+        uint64_t end = results[4 * i + 2];
+        uint64_t endAvailable = results[4 * i + 3];
+        if (!beginAvailable || !endAvailable) {
+            continue;
+        }
+
+        double milliseconds = ((end - begin) & timestampMask) * nanosecondsPerTick / 1e6;
+
+        ScopeHistory & scope = history[frame.scopeNames[i]];
+        if (scope.samples.size() < historyLength) {
+            scope.samples.push_back(milliseconds);
+        } else {
+            scope.samples[scope.next] = milliseconds;
+        }
+        scope.next = (scope.next + 1) % historyLength;
+
+        if (csv.is_open()) {
+            csv << frame.frameNumber << ',' << frame.scopeNames[i] << ',' << milliseconds << '\n';
+        }
+    }
+
+    frame.scopeNames.clear();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, size_t frameSlot) {
+    if (!enabled) {
+        return;
+    }
+
+    collect(frameSlot);
+
+    currentSlot = frameSlot;
+    slots[frameSlot].frameNumber = frameNumber++;
+    vkCmdResetQueryPool(commandBuffer, queryPool, frameSlot * maxScopesPerFrame * 2, maxScopesPerFrame * 2);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char * name) {
+    FrameSlot & frame = slots[currentSlot];
+    if (!enabled || frame.scopeNames.size() >= maxScopesPerFrame) {
+        return UINT32_MAX;
+    }
+
+    uint32_t scope = frame.scopeNames.size();
+    frame.scopeNames.push_back(name);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (currentSlot * maxScopesPerFrame + scope) * 2);
+    return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    if (!enabled || scope == UINT32_MAX) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (currentSlot * maxScopesPerFrame + scope) * 2 + 1);
+}
+
+void GpuProfiler::flush() {
+    if (!enabled) {
+        return;
+    }
+    for (size_t slot = 0; slot < slots.size(); slot++) {
+        collect(slot);
+    }
+}
+
+std::vector<GpuScopeSummary> GpuProfiler::summary() const {
+    std::vector<GpuScopeSummary> scopes;
+    for (auto & entry : history) {
+        std::vector<double> sorted = entry.second.samples;
+        if (sorted.empty()) {
+            continue;
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for (double sample : sorted) {
+            sum += sample;
+        }
+        size_t p99Index = std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.99));
+
+        scopes.push_back(GpuScopeSummary{ entry.first, sorted.front(), sum / sorted.size(), sorted[p99Index], sorted.size() });
+    }
+    return scopes;
+}
+
+void GpuProfiler::report(std::ostream & out) const {
+    if (!enabled) {
+        return;
+    }
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << std::left << std::setw(16) << "gpu time (ms)" << std::right
+        << std::setw(9) << "min" << std::setw(9) << "avg" << std::setw(9) << "p99" << '\n';
+    for (const GpuScopeSummary & scope : summary()) {
+        out << std::left << std::setw(16) << scope.name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(9) << scope.minMs
+            << std::setw(9) << scope.avgMs
+            << std::setw(9) << scope.p99Ms << '\n';
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void GpuProfiler::destroy() {
+    if (csv.is_open()) {
+        csv.close();
+    }
+    if (queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = VK_NULL_HANDLE;
+    }
+    enabled = false;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct GpuScopeSummary {
+    std::string name;
+    double minMs, avgMs, p99Ms;
+    size_t samples;
+};
+
+// GPU timing from timestamp queries.  Each frame slot owns a range of one query pool; the slot's results are read
+// when the slot comes around again, after its fence has signaled, so reading never stalls and lags the GPU by
+// the number of frames in flight.  Drivers without timestamp support (timestampValidBits == 0) turn it into a no-op.
+class GpuProfiler {
+    struct FrameSlot {
+        uint64_t frameNumber;
+        std::vector<std::string> scopeNames; // scope i wrote queries 2i and 2i+1 of this slot's range
+    };
+
+    struct ScopeHistory {
+        std::vector<double> samples; // milliseconds, a ring of the latest historyLength samples
+        size_t next = 0;
+    };
+
+    VkDevice device;
+    bool enabled;
+    VkQueryPool queryPool;
+    uint32_t maxScopesPerFrame;
+    double nanosecondsPerTick;
+    uint64_t timestampMask;
+
+    std::vector<FrameSlot> slots;
+    size_t currentSlot;
+    uint64_t frameNumber;
+    std::map<std::string, ScopeHistory> history;
+    std::ofstream csv;
+
+    void collect(size_t slot);
+
+public:
+    static const size_t historyLength = 256;
+
+    // frameSlots is the number of frames in flight, queueFamilyIndex is where the timed command buffers are submitted
+    GpuProfiler(VkPhysicalDevice gpu, VkDevice device, uint32_t queueFamilyIndex, size_t frameSlots, bool requested, uint32_t maxScopesPerFrame = 16);
+    ~GpuProfiler();
+
+    bool isEnabled() const { return enabled; }
+
+    // write one line per scope per frame: frame,scope,milliseconds
+    void openCsv(const std::string & filename);
+
+    // Call right after vkBeginCommandBuffer, once the slot's fence has signaled.  Reads the slot's previous results
+    // and records the reset of its queries, so it must be outside a render pass.
+    void beginFrame(VkCommandBuffer commandBuffer, size_t frameSlot);
+
+    // returns the scope index for endScope, scopes past maxScopesPerFrame are dropped
+    uint32_t beginScope(VkCommandBuffer commandBuffer, const char * name);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    // Read the results of every slot.  Only for after vkDeviceWaitIdle, so the last frames in flight are counted too.
+    void flush();
+
+    // forget collected timings, for instance between benchmark runs.  Call flush first so nothing is still pending.
+    void clearHistory() { history.clear(); }
+
+    // rolling min/avg/p99 over the latest historyLength frames of every scope
+    std::vector<GpuScopeSummary> summary() const;
+    void report(std::ostream & out) const;
+
+    // free the query pool, call before vkDestroyDevice
+    void destroy();
+};
+
+// times the commands recorded between construction and destruction
+struct GpuProfileScope {
+    GpuProfiler & profiler;
+    VkCommandBuffer commandBuffer;
+    uint32_t scope;
+    GpuProfileScope(GpuProfiler & profiler, VkCommandBuffer commandBuffer, const char * name) : profiler(profiler), commandBuffer(commandBuffer) {
+        scope = profiler.beginScope(commandBuffer, name);
+    }
+    ~GpuProfileScope() {
+        profiler.endScope(commandBuffer, scope);
+    }
+};
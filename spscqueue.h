@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded queue between exactly one producer thread and one consumer thread, without locks.  Each index is written
+// by one side only: the producer fills a slot and publishes it with a release store of tail, the consumer copies it
+// out and hands the slot back with a release store of head.  Neither side ever waits, a full or empty queue fails.
+template<typename T>
+class SpscQueue {
+    std::vector<T> slots; // one more than the capacity, so full and empty differ
+    alignas(64) std::atomic<size_t> head; // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next slot to push, written by the producer
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {}
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue & operator=(const SpscQueue &) = delete;
+
+    // producer only, false when full
+    bool tryPush(const T & value) {
+        size_t last = tail.load(std::memory_order_relaxed);
+        size_t next = (last + 1) % slots.size();
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[last] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, false when empty
+    bool tryPop(T & value) {
+        size_t first = head.load(std::memory_order_relaxed);
+        if (first == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[first];
+        head.store((first + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,66 @@
+#include "startup.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+const int barWidth = 40;
+
+}
+
+StartupTimeline::StartupTimeline() : start(Clock::now()), mainThread(std::this_thread::get_id()), printed(false) {
+}
+
+void StartupTimeline::record(const std::string & name, Clock::time_point begin, Clock::time_point end, bool mainThread) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!printed) {
+        stages.push_back(Stage{ name, begin, end, mainThread });
+    }
+}
+
+bool StartupTimeline::isPrinted() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return printed;
+}
+
+void StartupTimeline::printFirstFrame(std::ostream & out) {
+    Clock::time_point firstFrame = Clock::now();
+    std::vector<Stage> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (printed) {
+            return;
+        }
+        printed = true;
+        sorted = stages;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Stage & a, const Stage & b) { return a.begin < b.begin; });
+
+    double totalMs = Milliseconds(firstFrame - start).count();
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+
+    out << "startup timeline, ms since start\n";
+    out << std::right << std::setw(9) << "begin" << std::setw(9) << "end" << "  " << std::left << std::setw(6) << "on"
+        << std::setw(barWidth + 2) << "" << "stage\n";
+    for (const Stage & stage : sorted) {
+        double beginMs = Milliseconds(stage.begin - start).count();
+        double endMs = Milliseconds(stage.end - start).count();
+
+        // each column is totalMs / barWidth, a stage gets at least one
+        std::string bar(barWidth, ' ');
+        int first = std::min<int>(barWidth - 1, std::max(0.0, beginMs / totalMs * barWidth));
+        int last = std::min<int>(barWidth - 1, std::max<int>(first, endMs / totalMs * barWidth));
+        std::fill(bar.begin() + first, bar.begin() + last + 1, '#');
+
+        out << std::right << std::fixed << std::setprecision(1) << std::setw(9) << beginMs << std::setw(9) << endMs << "  "
+            << std::left << std::setw(6) << (stage.mainThread ? "main" : "job") << '|' << bar << "| " << stage.name << '\n';
+    }
+    out << "first frame submitted at " << std::setprecision(1) << totalMs << "ms" << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stages of startup recorded from any thread, printed as one timeline once the first frame is submitted so overlap
+// between the main thread and jobs shows, along with the time to first frame.  Times are relative to construction.
+class StartupTimeline {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    struct Stage {
+        std::string name;
+        Clock::time_point begin, end;
+        bool mainThread;
+    };
+
+    Clock::time_point start;
+    std::thread::id mainThread; // the constructing thread
+    mutable std::mutex mutex;
+    std::vector<Stage> stages;
+    bool printed;
+
+public:
+    StartupTimeline();
+
+    // stages recorded once the timeline is printed are dropped, since they are no longer startup
+    void record(const std::string & name, Clock::time_point begin, Clock::time_point end, bool mainThread);
+
+    // run f and record it as a stage of the calling thread
+    template<typename F>
+    void measure(const std::string & name, F && f) {
+        Clock::time_point begin = Clock::now();
+        f();
+        record(name, begin, Clock::now(), std::this_thread::get_id() == mainThread);
+    }
+
+    // print every stage ordered by start, with a bar chart scaled to the time to first frame, only the first time
+    void printFirstFrame(std::ostream & out);
+    bool isPrinted() const;
+};
@@ -0,0 +1,388 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+
+#include "mappedfile.h"
+#include "tga.h"
+
+namespace {
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+// A device local image that can be uploaded to, have its mips blitted and be sampled, and a view of every level.
+// Given a storage format the image is created in it instead, so the mip generator can write its levels, and the
+// view still reads it as format.
+std::tuple<VkImage, VkImageView, Allocation> createTextureImage(GpuAllocator & allocator, VkDevice device, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkFormat storageFormat = VK_FORMAT_UNDEFINED) {
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    if (storageFormat != VK_FORMAT_UNDEFINED) {
+        imageInfo.flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
+        imageInfo.format = storageFormat;
+    }
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // the upload transitions it
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (storageFormat != VK_FORMAT_UNDEFINED) {
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+    if (VK_SUCCESS != vkCreateImage(device, &imageInfo, nullptr, &image)) {
+        throw std::runtime_error("failed to create texture image");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+    Allocation allocation = allocator.allocate(memoryRequirements, MemoryUsage::GpuOnly, ResourceTiling::Optimal);
+    allocator.bindImage(image, allocation);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = mipLevels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView view;
+    if (VK_SUCCESS != vkCreateImageView(device, &viewInfo, nullptr, &view)) {
+        throw std::runtime_error("failed to create texture image view");
+    }
+
+    return std::make_tuple(image, view, allocation);
+}
+
+}
+
+TextureStreamer::TextureStreamer(JobSystem & jobs, size_t unstagedBudget)
+    : allocator(nullptr), device(VK_NULL_HANDLE), uploads(nullptr), jobs(jobs), stopping(false), unstagedBudget(unstagedBudget), unstagedBytes(0),
+      placeholderImage(VK_NULL_HANDLE), placeholder(VK_NULL_HANDLE) {
+}
+
+void TextureStreamer::attach(GpuAllocator & allocator, VkDevice device, UploadBatcher & uploads) {
+    {
+        std::lock_guard<std::mutex> lock(mutex); // decode jobs check uploads to pick where they decode to
+        this->allocator = &allocator;
+        this->device = device;
+        this->uploads = &uploads;
+    }
+
+    // mid grey, so a missing texture is obvious without being garish
+    const unsigned char texel[4] = { 128, 128, 128, 255 };
+    std::tie(placeholderImage, placeholder, placeholderAllocation) = createTextureImage(allocator, device, 1, 1, 1, VK_FORMAT_B8G8R8A8_SRGB);
+    uploads.uploadImage(placeholderImage, 1, 1, 1, texel, sizeof(texel));
+}
+
+TextureStreamer::~TextureStreamer() {
+    destroy();
+}
+
+TextureId TextureStreamer::request(const std::string & filename) {
+    TextureId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = textures.size();
+        textures.emplace_back();
+        Texture & texture = textures.back();
+        texture.filename = filename;
+        texture.state = State::Queued;
+        texture.byteCount = 0;
+        texture.width = texture.height = 0;
+        texture.bpp = 0;
+        texture.errorReported = false;
+        texture.ticket = 0;
+        texture.image = VK_NULL_HANDLE;
+        texture.view = VK_NULL_HANDLE;
+        texture.requested = std::chrono::steady_clock::now();
+    }
+    jobs.run([this, id]() { decode(id); }, &decodes);
+    return id;
+}
+
+void TextureStreamer::decode(TextureId id) {
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return;
+        }
+        textures[id].state = State::Decoding;
+        textures[id].decodeBegin = std::chrono::steady_clock::now();
+        filename = textures[id].filename;
+    }
+
+    // file reads and decoding, the slow part, happen without the lock
+    tga_info info = {};
+    std::vector<char> pixels;
+    StagingBuffer staging;
+    UploadBatcher * batcher = nullptr;
+    size_t reserved = 0;
+    std::string error;
+    try {
+        MappedFile file(filename.c_str());
+        info = read_tga_info(file.data(), file.size());
+        {
+            // the header gives the size, so the budget is checked here, before any pixel memory is taken
+            std::lock_guard<std::mutex> lock(mutex);
+            if (unstagedBytes > 0 && unstagedBytes + info.pixels_size > unstagedBudget) {
+                textures[id].state = State::Queued;
+                deferred.push_back(id);
+                return;
+            }
+            unstagedBytes += info.pixels_size;
+            reserved = info.pixels_size;
+            batcher = uploads;
+        }
+        if (batcher) {
+            staging = batcher->allocateStaging(info.pixels_size);
+            decode_tga(file.data(), file.size(), info, staging.allocation.mapped);
+        } else {
+            pixels.resize(info.pixels_size);
+            decode_tga(file.data(), file.size(), info, pixels.data());
+        }
+    } catch (const std::exception & e) {
+        error = e.what();
+        if (staging.buffer != VK_NULL_HANDLE) {
+            batcher->freeStaging(staging);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Texture & texture = textures[id];
+        texture.decodeEnd = std::chrono::steady_clock::now();
+        if (error.empty()) {
+            texture.pixels = std::move(pixels);
+            texture.staging = staging;
+            texture.byteCount = info.pixels_size;
+            texture.width = info.width;
+            texture.height = info.height;
+            texture.bpp = info.bpp;
+            texture.state = State::Decoded;
+        } else {
+            unstagedBytes -= reserved;
+            texture.error = error;
+            texture.state = State::Failed;
+        }
+    }
+}
+
+void TextureStreamer::stage(Texture & texture) {
+    // TGA is BGR order and by convention gamma corrected, so the bytes are sRGB
+    VkFormat format = (texture.bpp == 32) ? VK_FORMAT_B8G8R8A8_SRGB : VK_FORMAT_B8G8R8_SRGB;
+    uint32_t mipLevels = std::floor(std::log2(std::max(texture.width, texture.height))) + 1;
+
+    VkFormat storageFormat = uploads->mipStorageFormat(format);
+
+    std::tie(texture.image, texture.view, texture.allocation) = createTextureImage(*allocator, device, texture.width, texture.height, mipLevels, format, storageFormat);
+    if (texture.staging.buffer != VK_NULL_HANDLE) {
+        texture.ticket = uploads->uploadImage(texture.image, texture.width, texture.height, mipLevels, texture.staging, format);
+    } else {
+        texture.ticket = uploads->uploadImage(texture.image, texture.width, texture.height, mipLevels, texture.pixels.data(), texture.pixels.size(), format);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    texture.staging = StagingBuffer(); // the batch owns it now
+    std::vector<char>().swap(texture.pixels); // the staging buffer holds a copy now
+    unstagedBytes -= texture.byteCount;
+    texture.state = State::Uploading;
+}
+
+bool TextureStreamer::isLoading() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const Texture & texture : textures) {
+        if (texture.state == State::Queued || texture.state == State::Decoding || texture.state == State::Decoded) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// request may grow the deque from another thread, which moves its index even though entries stay put, so entries
+// are only looked up under the lock; the pointers are used after it, since only this thread changes such entries.
+void TextureStreamer::submitDecoded() {
+    std::vector<Texture*> toStage, failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Texture & texture : textures) {
+            if (texture.state == State::Decoded) {
+                toStage.push_back(&texture);
+            } else if (texture.state == State::Failed && !texture.errorReported) {
+                failed.push_back(&texture);
+            }
+        }
+    }
+
+    for (Texture * texture : failed) {
+        std::cout << "warning: failed to load texture " << texture->filename << ": " << texture->error << std::endl;
+        std::lock_guard<std::mutex> lock(mutex);
+        texture->errorReported = true;
+    }
+
+    // decoded textures go out in one batch, which later work on the queue is ordered after
+    for (Texture * texture : toStage) {
+        stage(*texture);
+    }
+    if (!toStage.empty()) {
+        uploads->submit();
+    }
+
+    // Staging freed budget, or there is nothing left holding it, so put-off decodes may fit now.  Those that still
+    // do not fit are put off again.
+    std::vector<TextureId> retry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!toStage.empty() || unstagedBytes == 0) {
+            retry.swap(deferred);
+        }
+    }
+    for (TextureId id : retry) {
+        jobs.run([this, id]() { decode(id); }, &decodes);
+    }
+}
+
+std::vector<TextureId> TextureStreamer::poll() {
+    submitDecoded();
+
+    // looked up under the lock as in submitDecoded
+    std::vector<std::tuple<TextureId, Texture*>> uploading;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (TextureId id = 0; id < textures.size(); id++) {
+            if (textures[id].state == State::Uploading) {
+                uploading.push_back(std::make_tuple(id, &textures[id]));
+            }
+        }
+    }
+
+    std::vector<TextureId> ready;
+    for (auto & entry : uploading) {
+        Texture * texture = std::get<1>(entry);
+        if (uploads->isReady(texture->ticket)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            texture->state = State::Resident;
+            texture->resident = std::chrono::steady_clock::now();
+            ready.push_back(std::get<0>(entry));
+        }
+    }
+    return ready;
+}
+
+void TextureStreamer::finish() {
+    // put-off decodes only run again once staging frees budget, so alternate until everything is staged
+    do {
+        jobs.wait(decodes); // this thread decodes too rather than sit idle
+        submitDecoded(); // the next poll reports these as resident
+    } while (isLoading());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Texture & texture : textures) {
+        if (texture.state == State::Uploading) {
+            uploads->wait(texture.ticket);
+        }
+    }
+}
+
+bool TextureStreamer::isResident(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return textures[texture].state == State::Resident;
+}
+
+VkImageView TextureStreamer::view(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return textures[texture].state == State::Resident ? textures[texture].view : placeholder;
+}
+
+double TextureStreamer::latencyMs(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Milliseconds(textures[texture].resident - textures[texture].requested).count();
+}
+
+std::tuple<bool, std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point> TextureStreamer::decodeSpan(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Texture & entry = textures[texture];
+    bool decoded = entry.state != State::Queued && entry.state != State::Decoding;
+    return std::make_tuple(decoded, entry.decodeBegin, entry.decodeEnd);
+}
+
+double TextureStreamer::decodeMs(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Milliseconds(textures[texture].decodeEnd - textures[texture].decodeBegin).count();
+}
+
+const std::string & TextureStreamer::filename(TextureId texture) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return textures[texture].filename;
+}
+
+TextureStreamStats TextureStreamer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    TextureStreamStats stats = {};
+    double totalLatencyMs = 0.0;
+    for (const Texture & texture : textures) {
+        switch (texture.state) {
+        case State::Queued: stats.queued++; break;
+        case State::Decoding: stats.decoding++; break;
+        case State::Decoded: stats.decoded++; break;
+        case State::Uploading: stats.uploading++; break;
+        case State::Failed: stats.failed++; break;
+        case State::Resident: {
+            stats.resident++;
+            double latency = Milliseconds(texture.resident - texture.requested).count();
+            totalLatencyMs += latency;
+            stats.maxLatencyMs = std::max(stats.maxLatencyMs, latency);
+            break;
+        }
+        }
+    }
+    if (stats.resident > 0) {
+        stats.meanLatencyMs = totalLatencyMs / stats.resident;
+    }
+    return stats;
+}
+
+void TextureStreamer::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobs.wait(decodes); // jobs still queued return at once, running ones finish their file
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Texture & texture : textures) {
+        if (texture.staging.buffer != VK_NULL_HANDLE) {
+            uploads->freeStaging(texture.staging); // decoded but never staged
+            texture.staging = StagingBuffer();
+        }
+        if (texture.image != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, texture.view, nullptr);
+            vkDestroyImage(device, texture.image, nullptr);
+            allocator->free(texture.allocation);
+            texture.image = VK_NULL_HANDLE;
+        }
+    }
+    if (placeholderImage != VK_NULL_HANDLE) {
+        vkDestroyImageView(device, placeholder, nullptr);
+        vkDestroyImage(device, placeholderImage, nullptr);
+        allocator->free(placeholderAllocation);
+        placeholderImage = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "allocator.h"
+#include "jobsystem.h"
+#include "upload.h"
+
+typedef uint32_t TextureId;
+
+struct TextureStreamStats {
+    size_t queued; // waiting for a job system worker
+    size_t decoding; // being read and decoded
+    size_t decoded; // waiting for the thread that owns the UploadBatcher to stage them
+    size_t uploading; // staged, their upload batch is not done yet
+    size_t resident;
+    size_t failed;
+    double meanLatencyMs, maxLatencyMs; // from request to resident, over every resident texture
+};
+
+// Loads TGA textures without holding up the frame loop.  Once attached, jobs decode files straight into staging
+// memory from the UploadBatcher; before that, during startup, into heap memory that is copied to staging later.
+// poll, called once per frame, creates images for decoded textures, hands their staging to the upload batch and
+// submits it, then reports which textures have become resident.  Until then, bind placeholderView instead.
+// Decoded pixels the batch has not taken yet are capped at unstagedBudget bytes: a decode that would pass it is put
+// off until staging frees room, though one texture is always let through so a file larger than the budget loads.
+// Only the thread that owns the UploadBatcher (the main thread, or the render thread with --render-thread) may call
+// anything but request and stats.  Requests may be made before the device exists, so decoding overlaps startup;
+// everything that touches Vulkan waits for attach.
+class TextureStreamer {
+    enum class State { Queued, Decoding, Decoded, Uploading, Resident, Failed };
+
+    struct Texture {
+        std::string filename;
+        State state;
+        std::vector<char> pixels; // decoded before attach, freed once staged
+        StagingBuffer staging; // decoded after attach, handed to the batch when staged
+        size_t byteCount; // of the decoded pixels, counted in unstagedBytes until staged
+        unsigned width, height;
+        int bpp;
+        std::string error;
+        bool errorReported;
+        UploadTicket ticket;
+        VkImage image;
+        VkImageView view;
+        Allocation allocation;
+        std::chrono::steady_clock::time_point requested, decodeBegin, decodeEnd, resident;
+    };
+
+    GpuAllocator * allocator; // these three are null until attach
+    VkDevice device;
+    UploadBatcher * uploads;
+
+    std::deque<Texture> textures; // indexed by TextureId, a deque so growing never moves an entry
+    JobSystem & jobs;
+    JobCounter decodes; // decode jobs not finished yet
+    mutable std::mutex mutex;
+    bool stopping; // decode jobs that have not started yet skip their texture
+    const size_t unstagedBudget;
+    size_t unstagedBytes; // reserved by decodes and not yet handed to the upload batch
+    std::vector<TextureId> deferred; // decodes put off by the budget, run again once staging frees some
+
+    VkImage placeholderImage;
+    VkImageView placeholder;
+    Allocation placeholderAllocation;
+
+    void decode(TextureId id);
+    void stage(Texture & texture);
+    bool isLoading() const; // anything queued, deferred, decoding or decoded but not staged
+
+public:
+    // textures are decoded by jobs, which may start before attach
+    explicit TextureStreamer(JobSystem & jobs, size_t unstagedBudget = 256ull * 1024 * 1024);
+    ~TextureStreamer();
+
+    // hand over what uploads need and record the upload of a one texel placeholder into the open batch
+    void attach(GpuAllocator & allocator, VkDevice device, UploadBatcher & uploads);
+
+    // queue a file for loading, safe from any thread
+    TextureId request(const std::string & filename);
+
+    // Stage what the decode jobs have finished, submit it, and return the textures that became resident since the
+    // last call.  A failed texture is reported once on stdout and keeps the placeholder.
+    std::vector<TextureId> poll();
+
+    // Block until every requested texture is uploaded or failed.  The next poll returns the uploaded ones.
+    void finish();
+
+    // Stage and submit everything the decode jobs have finished, reporting failures.  poll does this too; call it
+    // directly to start uploads early, the textures are reported by a later poll.
+    void submitDecoded();
+
+    bool isResident(TextureId texture) const;
+    VkImageView view(TextureId texture) const; // the placeholder until the texture is resident
+    VkImageView placeholderView() const { return placeholder; }
+    double latencyMs(TextureId texture) const; // request to resident
+    double decodeMs(TextureId texture) const;
+    // whether the texture has been decoded or failed to, and when decoding began and ended
+    std::tuple<bool, std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point> decodeSpan(TextureId texture) const;
+    const std::string & filename(TextureId texture) const;
+
+    TextureStreamStats stats() const;
+
+    // wait for decode jobs already running and free every image, call once the GPU no longer uses them
+    void destroy();
+};
@@ -0,0 +1,170 @@
+#include "texturetable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+bool TextureTable::isSupported(VkPhysicalDevice gpu) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    if (properties.apiVersion < VK_API_VERSION_1_1) {
+        return false; // features are queried through vkGetPhysicalDeviceFeatures2
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(gpu, nullptr, &extensionCount, extensions.data());
+    bool found = std::any_of(extensions.begin(), extensions.end(), [](const VkExtensionProperties & extension) {
+        return strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+    });
+    if (!found) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing = {};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexing;
+    vkGetPhysicalDeviceFeatures2(gpu, &features);
+
+    return indexing.runtimeDescriptorArray && indexing.descriptorBindingPartiallyBound
+        && indexing.descriptorBindingSampledImageUpdateAfterBind && indexing.descriptorBindingUpdateUnusedWhilePending
+        && indexing.shaderSampledImageArrayNonUniformIndexing;
+}
+
+VkPhysicalDeviceDescriptorIndexingFeaturesEXT TextureTable::requiredFeatures() {
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing = {};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexing.runtimeDescriptorArray = VK_TRUE; // sampler2D textures[] in the shader
+    indexing.descriptorBindingPartiallyBound = VK_TRUE;
+    indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    indexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE; // neighbouring fragments may sample different slots
+    return indexing;
+}
+
+TextureTable::TextureTable(VkPhysicalDevice gpu, VkDevice device, bool requested, uint32_t maxSlots)
+    : device(device), enabled(requested), setLayout(VK_NULL_HANDLE), pool(VK_NULL_HANDLE), set(VK_NULL_HANDLE), slotCount(0) {
+    if (!enabled) {
+        return;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing = {};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexing;
+    vkGetPhysicalDeviceProperties2(gpu, &properties);
+    slotCount = std::min({ maxSlots,
+        indexing.maxPerStageDescriptorUpdateAfterBindSampledImages, indexing.maxDescriptorSetUpdateAfterBindSampledImages,
+        indexing.maxPerStageDescriptorUpdateAfterBindSamplers, indexing.maxDescriptorSetUpdateAfterBindSamplers });
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = slotCount;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+        | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo = {};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flagsInfo.bindingCount = 1;
+    flagsInfo.pBindingFlags = &bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (VK_SUCCESS != vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout)) {
+        throw std::runtime_error("failed to create texture table layout");
+    }
+
+    VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slotCount };
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (VK_SUCCESS != vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool)) {
+        throw std::runtime_error("failed to create texture table pool");
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+    if (VK_SUCCESS != vkAllocateDescriptorSets(device, &allocInfo, &set)) {
+        throw std::runtime_error("failed to allocate texture table");
+    }
+
+    for (uint32_t slot = slotCount; slot > 0; slot--) {
+        freeSlots.push_back(slot - 1);
+    }
+}
+
+TextureTable::~TextureTable() {
+    destroy();
+}
+
+uint32_t TextureTable::add(VkImageView view, VkSampler sampler) {
+    if (!enabled) {
+        return 0;
+    }
+    if (freeSlots.empty()) {
+        throw std::runtime_error("texture table is full");
+    }
+    uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = view;
+    imageInfo.sampler = sampler;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.dstArrayElement = slot;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    return slot;
+}
+
+void TextureTable::remove(uint32_t slot, uint64_t lastUse) {
+    if (enabled) {
+        retired.push_back({ lastUse, slot });
+    }
+}
+
+void TextureTable::collect(uint64_t completed) {
+    auto due = std::stable_partition(retired.begin(), retired.end(), [completed](const Retired & entry) { return entry.lastUse > completed; });
+    for (auto it = due; it != retired.end(); ++it) {
+        freeSlots.push_back(it->slot);
+    }
+    retired.erase(due, retired.end());
+}
+
+void TextureTable::destroy() {
+    if (pool != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device, pool, nullptr); // frees the set
+        pool = VK_NULL_HANDLE;
+        set = VK_NULL_HANDLE;
+    }
+    if (setLayout != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+        setLayout = VK_NULL_HANDLE;
+    }
+    freeSlots.clear();
+    retired.clear();
+}
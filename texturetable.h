@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+// One descriptor set holding a large array of combined image samplers, so shaders pick a texture by index instead of
+// the CPU binding a set per texture (VK_EXT_descriptor_indexing).  The array is partially bound, so slots nothing
+// samples may stay unwritten, and update-after-bind with unused-while-pending, so add may write a free slot while
+// frames in flight use the set.  A slot that pending work may still sample must never be rewritten, so remove only
+// returns a slot to the free list once the frame that last could sample it is complete.  Which slots a frame samples
+// is up to the caller: slots add returned and that were not removed before the frame.
+// Created disabled when descriptor indexing was not requested or is unsupported, then every call is a no-op.
+class TextureTable {
+    struct Retired {
+        uint64_t lastUse;
+        uint32_t slot;
+    };
+
+    VkDevice device;
+    bool enabled;
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    uint32_t slotCount;
+    std::vector<uint32_t> freeSlots; // taken from the back, lowest slots first
+    std::vector<Retired> retired;
+
+public:
+    // whether the device has the extension and features the table needs, the instance must be Vulkan 1.1
+    static bool isSupported(VkPhysicalDevice gpu);
+
+    // the features to chain into VkDeviceCreateInfo when the table will be enabled
+    static VkPhysicalDeviceDescriptorIndexingFeaturesEXT requiredFeatures();
+
+    // maxSlots is lowered to what the device allows for update-after-bind sampled images
+    TextureTable(VkPhysicalDevice gpu, VkDevice device, bool requested, uint32_t maxSlots = 4096);
+    ~TextureTable();
+
+    bool isEnabled() const { return enabled; }
+
+    // set 1 of the pipeline layout, VK_NULL_HANDLE when disabled
+    VkDescriptorSetLayout layout() const { return setLayout; }
+    VkDescriptorSet descriptorSet() const { return set; }
+
+    uint32_t capacity() const { return slotCount; }
+    size_t freeCount() const { return freeSlots.size(); }
+
+    // write the view to a free slot and return the slot, throws when every slot is taken
+    uint32_t add(VkImageView view, VkSampler sampler);
+
+    // free the slot once the frame numbered lastUse is complete, frames after it must not sample the slot
+    void remove(uint32_t slot, uint64_t lastUse);
+
+    // put slots removed at or before completed back on the free list, call once per frame
+    void collect(uint64_t completed);
+
+    // call once no pending frame uses the set
+    void destroy();
+};
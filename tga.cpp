@@ -4,6 +4,19 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <atomic>
+#include <cstdint>
+
+// SSE2 is part of x86-64, AVX2 is picked at run time so the binary still runs on older CPUs
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define TGA_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define TGA_AVX2
+#endif
+#endif
 
 short le_short(unsigned char * bytes)
 {
@@ -69,87 +82,292 @@ void fail(const char * reason) {
     throw std::runtime_error(reason);
 }
 
-void * read_tga(const std::vector<char> & bytes, unsigned & width, unsigned & height, int & bpp) {
-	int color_map_size, pixels_size;
-    bool rle;
-	void *pixels;
+const unsigned char SCREEN_ORIGIN_BIT = 0x20;
+const u_char rleChunkFlag = 0x80;
+
+// offset of the first pixel byte, after the header, id string and color map
+size_t pixel_offset(const tga_header & header) {
+    size_t color_map_size = le_short((unsigned char*)header.color_map_length) * (header.color_map_depth / 8);
+    return sizeof(tga_header) + (u_char)header.id_length + color_map_size;
+}
+
+// Repeated pixel fills for RLE runs.  Each one writes exactly count pixels and never reads the destination, so the
+// vector versions store whole registers of a repeating pattern and finish the tail pixel by pixel.  Runs shorter
+// than the pattern go straight to the scalar loop, building the pattern would cost more than it saves.
+typedef void (*fill_function)(u_char * destination, const u_char * pixel, size_t pixelSize, size_t count);
+
+// fixed size copies compile to a single move each
+template <size_t pixelSize>
+void fill_pixels(u_char * destination, const u_char * pixel, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        memcpy(destination + i * pixelSize, pixel, pixelSize);
+    }
+}
+
+void fill_scalar(u_char * destination, const u_char * pixel, size_t pixelSize, size_t count) {
+    if (pixelSize == 4) {
+        fill_pixels<4>(destination, pixel, count);
+    } else {
+        fill_pixels<3>(destination, pixel, count);
+    }
+}
 
-    printf("header size: %lu\n", sizeof(tga_header));
+// the pixel repeated to fill byteCount bytes, a multiple of 3, by doubling what is already there
+void repeat_pixel(u_char * pattern, const u_char * pixel, size_t byteCount) {
+    memcpy(pattern, pixel, 3);
+    for (size_t filled = 3; filled < byteCount; filled *= 2) {
+        memcpy(pattern + filled, pattern, std::min(filled, byteCount - filled));
+    }
+}
 
-	if (bytes.size() < sizeof(tga_header)) {
+#ifdef TGA_SSE2
+void fill_sse2(u_char * destination, const u_char * pixel, size_t pixelSize, size_t count) {
+    if (pixelSize == 4) {
+        if (count >= 4) {
+            uint32_t value;
+            memcpy(&value, pixel, 4);
+            __m128i pattern = _mm_set1_epi32(value);
+            for (; count >= 4; count -= 4, destination += 16) {
+                _mm_storeu_si128((__m128i*)destination, pattern);
+            }
+        }
+        fill_pixels<4>(destination, pixel, count);
+    } else {
+        // 16 pixels of 3 bytes fill exactly three registers
+        if (count >= 16) {
+            alignas(16) u_char bytes[48];
+            repeat_pixel(bytes, pixel, sizeof(bytes));
+            __m128i a = _mm_load_si128((const __m128i*)bytes);
+            __m128i b = _mm_load_si128((const __m128i*)(bytes + 16));
+            __m128i c = _mm_load_si128((const __m128i*)(bytes + 32));
+            for (; count >= 16; count -= 16, destination += 48) {
+                _mm_storeu_si128((__m128i*)destination, a);
+                _mm_storeu_si128((__m128i*)(destination + 16), b);
+                _mm_storeu_si128((__m128i*)(destination + 32), c);
+            }
+        }
+        fill_pixels<3>(destination, pixel, count);
+    }
+}
+#endif
+
+#ifdef TGA_AVX2
+__attribute__((target("avx2")))
+void fill_avx2(u_char * destination, const u_char * pixel, size_t pixelSize, size_t count) {
+    if (pixelSize == 4) {
+        if (count >= 8) {
+            uint32_t value;
+            memcpy(&value, pixel, 4);
+            __m256i pattern = _mm256_set1_epi32(value);
+            for (; count >= 8; count -= 8, destination += 32) {
+                _mm256_storeu_si256((__m256i*)destination, pattern);
+            }
+        }
+        fill_pixels<4>(destination, pixel, count);
+    } else if (count >= 32) {
+        // 32 pixels of 3 bytes fill exactly three registers
+        alignas(32) u_char bytes[96];
+        repeat_pixel(bytes, pixel, sizeof(bytes));
+        __m256i a = _mm256_load_si256((const __m256i*)bytes);
+        __m256i b = _mm256_load_si256((const __m256i*)(bytes + 32));
+        __m256i c = _mm256_load_si256((const __m256i*)(bytes + 64));
+        for (; count >= 32; count -= 32, destination += 96) {
+            _mm256_storeu_si256((__m256i*)destination, a);
+            _mm256_storeu_si256((__m256i*)(destination + 32), b);
+            _mm256_storeu_si256((__m256i*)(destination + 64), c);
+        }
+        fill_pixels<3>(destination, pixel, count);
+    } else {
+        fill_sse2(destination, pixel, pixelSize, count);
+    }
+}
+#endif
+
+bool tga_fill_supported(tga_fill fill) {
+    switch (fill) {
+    case tga_fill::scalar:
+        return true;
+#ifdef TGA_SSE2
+    case tga_fill::sse2:
+        return true;
+#endif
+#ifdef TGA_AVX2
+    case tga_fill::avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+tga_fill widest_fill() {
+    for (tga_fill fill : { tga_fill::avx2, tga_fill::sse2 }) {
+        if (tga_fill_supported(fill)) {
+            return fill;
+        }
+    }
+    return tga_fill::scalar;
+}
+
+// decoders may run on several threads, the choice is made once and only changed by benchmarks
+std::atomic<tga_fill> current_fill(widest_fill());
+
+void set_tga_fill(tga_fill fill) {
+    if (!tga_fill_supported(fill)) {
+        fail("tga fill is not supported on this cpu");
+    }
+    current_fill = fill;
+}
+
+tga_fill get_tga_fill() {
+    return current_fill;
+}
+
+const char * tga_fill_name(tga_fill fill) {
+    switch (fill) {
+    case tga_fill::sse2: return "sse2";
+    case tga_fill::avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+fill_function fill_for(tga_fill fill) {
+    switch (fill) {
+#ifdef TGA_SSE2
+    case tga_fill::sse2: return fill_sse2;
+#endif
+#ifdef TGA_AVX2
+    case tga_fill::avx2: return fill_avx2;
+#endif
+    default: return fill_scalar;
+    }
+}
+
+tga_info read_tga_info(const char * bytes, size_t size) {
+    if (size < sizeof(tga_header)) {
         fail("data has no tga header");
-	}
-    tga_header & header = *(tga_header*)bytes.data();
+    }
+    const tga_header & header = *(const tga_header*)bytes;
 
-	if (header.data_type_code != 2 && header.data_type_code != 10) {
+    if (header.data_type_code != 2 && header.data_type_code != 10) {
         fail("data is not a truecolor tga");
-	}
+    }
     if (header.bits_per_pixel != 24 && header.bits_per_pixel != 32) {
-		fail("data is not a 24 or 32-bit uncompressed RGB tga file");
-	}
-
-    bpp = header.bits_per_pixel;
-    u_char pixelSize = bpp / 8;
-    rle = header.data_type_code == 2 ? false : true;
-
-    int remainingBytes = bytes.size() - sizeof(tga_header);
-	if (remainingBytes < header.id_length) {
-		fail("data has incomplete id string");
-	}
-    remainingBytes -= header.id_length;
+        fail("data is not a 24 or 32-bit uncompressed RGB tga file");
+    }
 
-	color_map_size = le_short(header.color_map_length) * (header.color_map_depth / 8);
-	if (remainingBytes < color_map_size) {
-		fail("file has incomplete color map");
-	}
+    size_t remainingBytes = size - sizeof(tga_header);
+    if (remainingBytes < (u_char)header.id_length) {
+        fail("data has incomplete id string");
+    }
+    remainingBytes -= (u_char)header.id_length;
 
+    size_t color_map_size = le_short((unsigned char*)header.color_map_length) * (header.color_map_depth / 8);
+    if (remainingBytes < color_map_size) {
+        fail("file has incomplete color map");
+    }
     remainingBytes -= color_map_size;
 
-	width = le_short(header.width); height = le_short(header.height);
-	pixels_size = width * height * (header.bits_per_pixel / 8);
+    tga_info info;
+    info.width = (unsigned short)le_short((unsigned char*)header.width);
+    info.height = (unsigned short)le_short((unsigned char*)header.height);
+    info.bpp = header.bits_per_pixel;
+    info.pixels_size = (size_t)info.width * info.height * (info.bpp / 8);
 
-    if (remainingBytes < pixels_size) {
+    // compressed data is usually smaller than the image, decode_tga checks it packet by packet
+    bool rle = header.data_type_code == 10;
+    if (!rle && remainingBytes < info.pixels_size) {
         fail("data has incomplete image");
     }
 
-	pixels = malloc(pixels_size);
-    const u_char rleChunkFlag = 0x80;
-    const char * currentByte = &bytes[0] + (bytes.size() - remainingBytes);
+    return info;
+}
+
+void decode_tga(const char * bytes, size_t size, const tga_info & info, void * destination) {
+    const tga_header & header = *(const tga_header*)bytes;
+    bool rle = header.data_type_code == 10;
+
+    // origin in bottom-left is opposite of Vulkan convention, so those rows are written bottom up
+    bool flip = (header.image_descriptor & SCREEN_ORIGIN_BIT) == 0;
+
+    size_t pixelSize = info.bpp / 8;
+    size_t rowSize = pixelSize * info.width;
+    auto rowStart = [&](unsigned y) {
+        return (u_char*)destination + (flip ? info.height - 1 - y : y) * rowSize;
+    };
+
+    const u_char * currentByte = (const u_char*)bytes + pixel_offset(header);
+    const u_char * lastByte = (const u_char*)bytes + size;
+
     if (!rle) {
-        memcpy(pixels, currentByte, pixels_size);
-    } else {
-        u_char * pixelCursor = (u_char*)pixels;
-        u_char * end = pixelCursor + (width  * height * pixelSize);
+        for (unsigned y = 0; y < info.height; y++) {
+            memcpy(rowStart(y), currentByte + y * rowSize, rowSize);
+        }
+        return;
+    }
+
+    fill_function fill = fill_for(current_fill);
+
+    // packets may cross rows, so each one is written in row sized pieces
+    unsigned y = 0;
+    size_t rowPixelsLeft = info.width;
+    u_char * out = info.height > 0 ? rowStart(0) : nullptr;
+    while (y < info.height) {
+        if (currentByte >= lastByte) {
+            fail("rle data is truncated");
+        }
         u_char chunkHeader = *currentByte++;
-        do {
-            if (chunkHeader & rleChunkFlag) { // rle compressed chunk
-                u_char pixelCount = (chunkHeader ^ rleChunkFlag) + 1; // remove flag
-                for (int i = 0; i < pixelCount; i++) {
-                    memcpy(pixelCursor, currentByte, pixelSize);
-                    pixelCursor += pixelSize;
-                }
+        size_t pixelCount = (chunkHeader & ~rleChunkFlag) + 1;
+        bool repeated = chunkHeader & rleChunkFlag;
+
+        size_t sourceBytes = repeated ? pixelSize : pixelCount * pixelSize;
+        if ((size_t)(lastByte - currentByte) < sourceBytes) {
+            fail("rle data is truncated");
+        }
+
+        while (pixelCount > 0) {
+            if (y >= info.height) {
+                fail("rle packet runs past the end of the image");
+            }
+            size_t count = std::min(pixelCount, rowPixelsLeft);
+            if (repeated) { // rle compressed chunk, one pixel repeated
+                fill(out, currentByte, pixelSize, count);
             } else {
-                u_char pixelCount = chunkHeader + 1;
-                memcpy(pixelCursor, currentByte, pixelCount * pixelSize);
-                pixelCursor += (pixelCount * pixelSize);
-                currentByte += (pixelCount * pixelSize);
+                memcpy(out, currentByte, count * pixelSize);
+                currentByte += count * pixelSize;
+            }
+            out += count * pixelSize;
+            pixelCount -= count;
+            rowPixelsLeft -= count;
+
+            if (rowPixelsLeft == 0) {
+                rowPixelsLeft = info.width;
+                y++;
+                if (y < info.height) {
+                    out = rowStart(y);
+                }
             }
-        } while (pixelCursor < end);
+        }
+        if (repeated) {
+            currentByte += pixelSize;
+        }
     }
+}
 
-    const unsigned char SCREEN_ORIGIN_BIT = 0x20;
+void * read_tga(const std::vector<char> & bytes, unsigned & width, unsigned & height, int & bpp) {
+    tga_info info = read_tga_info(bytes.data(), bytes.size());
 
-    if (header.image_descriptor & SCREEN_ORIGIN_BIT == 0) {
-        // origin is in bottom-left, which is opposite of Vulkan convention, so flip the image rows
-        u_char * source = (u_char*)pixels;
-        u_char * flipped = (u_char*)malloc(pixels_size);
-        unsigned rowSize = pixelSize * width;
-        for (size_t i = 0; i < height; i++) {
-            memcpy(flipped + i * rowSize, source + ((height - 1 - i) * rowSize), rowSize);
-        }
+    void * pixels = malloc(info.pixels_size);
+    try {
+        decode_tga(bytes.data(), bytes.size(), info, pixels);
+    } catch (...) {
         free(pixels);
-        pixels = flipped;
+        throw;
     }
 
-	return pixels;
+    width = info.width;
+    height = info.height;
+    bpp = info.bpp;
+    return pixels;
 }
@@ -1,7 +1,31 @@
 #pragma once
 
+#include <cstddef>
 #include <vector>
 
+struct tga_info {
+    unsigned width, height;
+    int bpp;
+    size_t pixels_size; // bytes of decoded pixels, width * height * bpp / 8
+};
+
+// Validate the header of TGA data and report the decoded size, so the caller can provide the destination before decoding.
+tga_info read_tga_info(const char * bytes, size_t size);
+
+// Decode into destination, which must hold info.pixels_size bytes.  RLE packets are expanded and bottom-up images
+// are flipped on the way, so every pixel is written once and the destination is never read, which keeps this
+// fast on write-combined memory such as a mapped staging buffer.
+void decode_tga(const char * bytes, size_t size, const tga_info & info, void * destination);
+
+// Implementations of the RLE run fill.  decode_tga uses the widest one the CPU supports unless set_tga_fill picks
+// another, which benchmarks use to compare them.  All of them write the same bytes.
+enum class tga_fill { scalar, sse2, avx2 };
+bool tga_fill_supported(tga_fill fill);
+void set_tga_fill(tga_fill fill); // throws if the CPU or build does not support it
+tga_fill get_tga_fill();
+const char * tga_fill_name(tga_fill fill);
+
+// Decode into a malloc'd buffer the caller frees.
 void * read_tga(const std::vector<char> & bytes, unsigned & width, unsigned & height, int & bpp);
 
 bool write_tga(const char * filename, unsigned width, unsigned height, const unsigned char * data);
\ No newline at end of file
@@ -1,14 +1,33 @@
 #version 450
 layout(location = 0) in vec3 inPos;
 layout(location = 1) in vec2 inUV;  
+layout(location = 2) in uint inTextureSlot;
 
 layout(location = 1) out vec2 uv;
+layout(location = 2) flat out uint textureSlot; // only bindless.frag reads it
+
+// Set when the quads are drawn directly in several draws over the whole vertex storage rather than with the one
+// indirect draw, so vertices past the count compute emitted hold stale data and must not be drawn.
+layout(constant_id = 0) const bool clipToEmitted = false;
 
 layout(std140, binding = 0) uniform matrixBuffer {
     layout(offset=0) mat4 viewProjection;
 };
 
+// the VkDrawIndirectCommand compute wrote, vertexCount is how many vertices it emitted
+layout(std430, binding = 3) readonly buffer DrawIndirect {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+} draw;
+
 void main() {
     uv = inUV;
+    textureSlot = inTextureSlot;
+    if (clipToEmitted && uint(gl_VertexIndex) >= draw.vertexCount) {
+        gl_Position = vec4(0.0, 0.0, -1.0, 1.0); // behind the near plane, so the whole triangle is clipped
+        return;
+    }
     gl_Position = viewProjection * vec4(inPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,90 @@
+#include "uniformring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+UniformRing::UniformRing(VkPhysicalDevice gpu, GpuAllocator & allocator, VkDevice device, size_t regionCount, VkDeviceSize regionSize,
+        const std::vector<uint32_t> & queueFamilies)
+    : device(device), allocator(allocator), buffer(VK_NULL_HANDLE), regionCount(regionCount), currentRegion(0), used(0), highWater(0),
+      queueFamilies(queueFamilies) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    // regions start aligned too, so an offset is aligned no matter which region it is in
+    this->regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+    createBuffer();
+}
+
+void UniformRing::createBuffer() {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = regionSize * regionCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT; // no ownership transfers for data rewritten every frame
+        bufferInfo.queueFamilyIndexCount = queueFamilies.size();
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    if (VK_SUCCESS != vkCreateBuffer(device, &bufferInfo, nullptr, &buffer)) {
+        throw std::runtime_error("failed to create uniform ring buffer");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+    allocation = allocator.allocate(memoryRequirements, MemoryUsage::Dynamic, ResourceTiling::Linear);
+    allocator.bindBuffer(buffer, allocation);
+}
+
+std::tuple<VkBuffer, Allocation> UniformRing::resize(size_t regionCount) {
+    std::tuple<VkBuffer, Allocation> old = std::make_tuple(buffer, allocation);
+    this->regionCount = regionCount;
+    currentRegion = 0;
+    used = 0;
+    createBuffer();
+    return old;
+}
+
+UniformRing::~UniformRing() {
+    destroy();
+}
+
+void UniformRing::beginFrame(size_t region) {
+    if (region >= regionCount) {
+        throw std::runtime_error("uniform ring has no such region");
+    }
+    currentRegion = region;
+    used = 0;
+}
+
+std::tuple<uint32_t, void*> UniformRing::allocate(VkDeviceSize byteCount) {
+    if (used + byteCount > regionSize) {
+        throw std::runtime_error("frame used more uniform memory than a uniform ring region holds");
+    }
+
+    VkDeviceSize offset = currentRegion * regionSize + used;
+    used += (byteCount + alignment - 1) / alignment * alignment;
+    highWater = std::max(highWater, used);
+
+    return std::make_tuple((uint32_t)offset, (char*)allocation.mapped + offset);
+}
+
+uint32_t UniformRing::push(const void * data, VkDeviceSize byteCount) {
+    uint32_t offset;
+    void * destination;
+    std::tie(offset, destination) = allocate(byteCount);
+    memcpy(destination, data, byteCount); // host coherent, no flush
+    return offset;
+}
+
+void UniformRing::destroy() {
+    if (buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        allocator.free(allocation);
+        buffer = VK_NULL_HANDLE;
+    }
+}
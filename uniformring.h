@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "allocator.h"
+
+// Uniform memory for data that changes every frame or every draw.  One buffer, mapped for its whole life, is split
+// into a region per frame slot; a frame bump allocates from the start of its region, so an allocation costs no
+// vkAllocateMemory, no map and no descriptor write.  Offsets respect minUniformBufferOffsetAlignment and are meant
+// as dynamic offsets of a UNIFORM_BUFFER_DYNAMIC binding that points at the start of the buffer.
+// A region may only be reset by beginFrame once the GPU is done with the frame that last used it.  A recorded
+// command buffer keeps its dynamic offsets, which stay right as long as its frame allocates the same sizes in the
+// same order every time.  Pass more than one queue family when queues of several families read the uniforms.
+class UniformRing {
+    VkDevice device;
+    GpuAllocator & allocator;
+    VkBuffer buffer;
+    Allocation allocation;
+    VkDeviceSize alignment;
+    VkDeviceSize regionSize;
+    size_t regionCount;
+    size_t currentRegion;
+    VkDeviceSize used; // bytes handed out from the current region
+    VkDeviceSize highWater; // most bytes any frame has used, to size regions
+    std::vector<uint32_t> queueFamilies;
+
+    void createBuffer();
+
+public:
+    UniformRing(VkPhysicalDevice gpu, GpuAllocator & allocator, VkDevice device, size_t regionCount, VkDeviceSize regionSize,
+        const std::vector<uint32_t> & queueFamilies = {});
+    ~UniformRing();
+
+    VkBuffer handle() const { return buffer; }
+    const Allocation & memory() const { return allocation; }
+    size_t regions() const { return regionCount; }
+    VkDeviceSize peakFrameBytes() const { return highWater; }
+
+    // start handing out the region, forgetting what was allocated from it before
+    void beginFrame(size_t region);
+
+    // byteCount bytes of the current region, as a dynamic offset and a pointer to write them through
+    std::tuple<uint32_t, void*> allocate(VkDeviceSize byteCount);
+
+    // allocate and copy, returns the dynamic offset
+    uint32_t push(const void * data, VkDeviceSize byteCount);
+
+    // Switch to a new buffer of regionCount regions, such as when a recreated swap chain has more images than there
+    // are regions.  Returns the old buffer and its memory, for the caller to destroy once no pending frame reads them;
+    // descriptor sets pointing at the old buffer must be replaced.
+    std::tuple<VkBuffer, Allocation> resize(size_t regionCount);
+
+    // call before destroying the allocator, once the GPU is done with every region
+    void destroy();
+};
@@ -0,0 +1,453 @@
+#include "upload.h"
+
+#include <cstring>
+#include <stdexcept>
+
+void recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {
+        width,
+        height,
+        1
+    };
+
+    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image, int width, int height, size_t mipLevelCount) {
+    VkImageMemoryBarrier writeToReadBarrier = {};
+    writeToReadBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    writeToReadBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    writeToReadBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    writeToReadBarrier.image = image;
+    writeToReadBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    writeToReadBarrier.subresourceRange.baseArrayLayer = 0;
+    writeToReadBarrier.subresourceRange.layerCount = 1;
+    writeToReadBarrier.subresourceRange.levelCount = 1;
+    writeToReadBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL; // previous level was written by a copy or blit, keep its contents
+    writeToReadBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    writeToReadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    writeToReadBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkImageMemoryBarrier readToSampleBarrier = writeToReadBarrier;
+    readToSampleBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    readToSampleBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    readToSampleBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    readToSampleBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkImageBlit blit{}; // blit configuration shared for all mip levels
+    blit.srcOffsets[0] = { 0, 0, 0 };
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = { 0, 0, 0 };
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    int mipWidth = width;
+    int mipHeight = height;
+
+    for (size_t i=1; i<mipLevelCount; i++) {
+        writeToReadBarrier.subresourceRange.baseMipLevel = i - 1;
+        readToSampleBarrier.subresourceRange.baseMipLevel = i - 1;
+
+        blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+        blit.srcSubresource.mipLevel = i - 1;
+        blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+        blit.dstSubresource.mipLevel = i;
+
+        // previous mip write -> read
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &writeToReadBarrier);
+
+        vkCmdBlitImage(commandBuffer,
+            image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit,
+            VK_FILTER_LINEAR);
+
+        // previous mip read -> sample
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &readToSampleBarrier);
+
+        if (mipWidth > 1) mipWidth /= 2;
+        if (mipHeight > 1) mipHeight /= 2;
+    }
+
+    // transition the final mip to shader read
+    VkImageMemoryBarrier writeToSampleBarrier = readToSampleBarrier;
+    writeToSampleBarrier.subresourceRange.baseMipLevel = mipLevelCount - 1;
+    writeToSampleBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    writeToSampleBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &writeToSampleBarrier);
+}
+
+UploadBatcher::UploadBatcher(GpuAllocator & allocator, VkDevice device, UploadQueue graphics, UploadQueue transfer, MipGenerator * mipGenerator)
+    : allocator(allocator), device(device), graphics(graphics), transfer(transfer), dedicatedTransfer(graphics.family != transfer.family), mipGenerator(mipGenerator), completedTicket(0) {
+    open = Batch{};
+    open.ticket = 1;
+}
+
+UploadBatcher::~UploadBatcher() {
+    destroy();
+}
+
+VkCommandBuffer UploadBatcher::beginCommandBuffer(VkCommandPool commandPool) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (VK_SUCCESS != vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer)) {
+        throw std::runtime_error("failed to allocate upload command buffer");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (VK_SUCCESS != vkBeginCommandBuffer(commandBuffer, &beginInfo)) {
+        throw std::runtime_error("failed to begin recording upload command buffer");
+    }
+    return commandBuffer;
+}
+
+void UploadBatcher::beginBatch() {
+    open.commandBuffer = beginCommandBuffer(transfer.commandPool);
+    if (dedicatedTransfer) {
+        open.acquireCommandBuffer = beginCommandBuffer(graphics.commandPool);
+    }
+}
+
+VkFormat UploadBatcher::mipStorageFormat(VkFormat sampledFormat) const {
+    return mipGenerator ? mipGenerator->storageFormat(sampledFormat) : VK_FORMAT_UNDEFINED;
+}
+
+UploadTicket UploadBatcher::uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void * pixels, size_t byteCount, VkFormat format) {
+    UploadTicket ticket;
+    void * staged;
+    std::tie(ticket, staged) = stageImage(image, width, height, mipLevels, byteCount, format);
+    memcpy(staged, pixels, byteCount);
+    return ticket;
+}
+
+StagingBuffer & UploadBatcher::createStaging(size_t byteCount) {
+    if (open.commandBuffer == VK_NULL_HANDLE) {
+        beginBatch();
+    }
+
+    // host writes before vkQueueSubmit are visible to the device without a barrier, so the bytes may arrive any time before submit
+    open.staging.push_back(allocateStaging(byteCount));
+    return open.staging.back();
+}
+
+// touches only the device and the allocator, which has a lock of its own
+StagingBuffer UploadBatcher::allocateStaging(size_t byteCount) {
+    // staging memory is bump allocated, it goes back to the allocator when the batch holding it completes
+    StagingBuffer staging;
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = byteCount;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (VK_SUCCESS != vkCreateBuffer(device, &bufferInfo, nullptr, &staging.buffer)) {
+        throw std::runtime_error("failed to create staging buffer");
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device, staging.buffer, &memoryRequirements);
+    staging.allocation = allocator.allocate(memoryRequirements, MemoryUsage::Upload, ResourceTiling::Linear, AllocationStrategy::Linear);
+    allocator.bindBuffer(staging.buffer, staging.allocation);
+    return staging;
+}
+
+void UploadBatcher::freeStaging(const StagingBuffer & staging) {
+    vkDestroyBuffer(device, staging.buffer, nullptr);
+    allocator.free(staging.allocation);
+}
+
+UploadTicket UploadBatcher::uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const StagingBuffer & staging, VkFormat format) {
+    if (open.commandBuffer == VK_NULL_HANDLE) {
+        beginBatch();
+    }
+    open.staging.push_back(staging); // freed with the batch's own staging
+    recordImageUpload(staging.buffer, image, width, height, mipLevels, format);
+    return open.ticket;
+}
+
+UploadTicket UploadBatcher::uploadBuffer(VkBuffer buffer, const void * data, size_t byteCount) {
+    StagingBuffer & staging = createStaging(byteCount);
+    memcpy(staging.allocation.mapped, data, byteCount);
+
+    VkBufferCopy region = {};
+    region.size = byteCount;
+    vkCmdCopyBuffer(open.commandBuffer, staging.buffer, buffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = byteCount;
+
+    if (!dedicatedTransfer) {
+        vkCmdPipelineBarrier(open.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+        return open.ticket;
+    }
+
+    // the release half makes the copy available, the acquire half on the graphics queue makes it visible
+    barrier.srcQueueFamilyIndex = transfer.family;
+    barrier.dstQueueFamilyIndex = graphics.family;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(open.commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        1, &barrier,
+        0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(open.acquireCommandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr,
+        1, &barrier,
+        0, nullptr);
+
+    return open.ticket;
+}
+
+std::tuple<UploadTicket, void*> UploadBatcher::stageImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, size_t byteCount, VkFormat format) {
+    StagingBuffer & staging = createStaging(byteCount);
+    recordImageUpload(staging.buffer, image, width, height, mipLevels, format);
+    return std::make_tuple(open.ticket, staging.allocation.mapped);
+}
+
+void UploadBatcher::recordImageUpload(VkBuffer staging, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format) {
+
+    // Vulkan spec says images MUST be created either undefined or preinitialized layout, so we can't jump straight to DST_OPTIMAL.
+    // Every level goes to DST at once so the mip chain only needs barriers between neighbouring levels.
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(open.commandBuffer,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &barrier);
+
+    recordCopyBufferToImage(open.commandBuffer, staging, image, width, height);
+
+    if (dedicatedTransfer) {
+        // Hand every level to the graphics family, still in DST_OPTIMAL since the mip chain is built there.
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = transfer.family;
+        barrier.dstQueueFamilyIndex = graphics.family;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(open.commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(open.acquireCommandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+    }
+    VkCommandBuffer mipCommandBuffer = dedicatedTransfer ? open.acquireCommandBuffer : open.commandBuffer;
+    if (mipLevels > 1 && mipStorageFormat(format) != VK_FORMAT_UNDEFINED) {
+        open.releases.push_back(mipGenerator->record(mipCommandBuffer, image, format, width, height, mipLevels));
+    } else {
+        recordMipmaps(mipCommandBuffer, image, width, height, mipLevels);
+    }
+}
+
+UploadTicket UploadBatcher::submit() {
+    if (open.commandBuffer == VK_NULL_HANDLE) {
+        return open.ticket - 1; // nothing recorded, the previous batch is the latest
+    }
+
+    if (VK_SUCCESS != vkEndCommandBuffer(open.commandBuffer)) {
+        throw std::runtime_error("failed to end upload command buffer");
+    }
+    if (dedicatedTransfer && VK_SUCCESS != vkEndCommandBuffer(open.acquireCommandBuffer)) {
+        throw std::runtime_error("failed to end upload command buffer");
+    }
+
+    if (spareFences.empty()) {
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (VK_SUCCESS != vkCreateFence(device, &fenceInfo, nullptr, &open.fence)) {
+            throw std::runtime_error("failed to create upload fence");
+        }
+    } else {
+        open.fence = spareFences.back();
+        spareFences.pop_back();
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &open.commandBuffer;
+
+    if (!dedicatedTransfer) {
+        if (VK_SUCCESS != vkQueueSubmit(transfer.queue, 1, &submitInfo, open.fence)) {
+            throw std::runtime_error("failed to submit upload batch");
+        }
+    } else {
+        if (spareSemaphores.empty()) {
+            VkSemaphoreCreateInfo semaphoreInfo = {};
+            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            if (VK_SUCCESS != vkCreateSemaphore(device, &semaphoreInfo, nullptr, &open.transferDone)) {
+                throw std::runtime_error("failed to create upload semaphore");
+            }
+        } else {
+            open.transferDone = spareSemaphores.back();
+            spareSemaphores.pop_back();
+        }
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &open.transferDone;
+        if (VK_SUCCESS != vkQueueSubmit(transfer.queue, 1, &submitInfo, VK_NULL_HANDLE)) {
+            throw std::runtime_error("failed to submit upload batch");
+        }
+
+        // the acquire barriers are the first thing that touches the uploads, so nothing earlier needs to wait
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        acquireInfo.waitSemaphoreCount = 1;
+        acquireInfo.pWaitSemaphores = &open.transferDone;
+        acquireInfo.pWaitDstStageMask = &waitStage;
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &open.acquireCommandBuffer;
+        if (VK_SUCCESS != vkQueueSubmit(graphics.queue, 1, &acquireInfo, open.fence)) {
+            throw std::runtime_error("failed to submit upload ownership acquire");
+        }
+    }
+
+    UploadTicket submitted = open.ticket;
+    inFlight.push_back(std::move(open));
+
+    open = Batch{};
+    open.ticket = submitted + 1;
+
+    return submitted;
+}
+
+void UploadBatcher::retire(Batch & batch) {
+    for (StagingBuffer & staging : batch.staging) {
+        freeStaging(staging);
+    }
+    for (auto & release : batch.releases) {
+        release();
+    }
+    vkFreeCommandBuffers(device, transfer.commandPool, 1, &batch.commandBuffer);
+    if (batch.acquireCommandBuffer != VK_NULL_HANDLE) {
+        vkFreeCommandBuffers(device, graphics.commandPool, 1, &batch.acquireCommandBuffer);
+    }
+    if (batch.transferDone != VK_NULL_HANDLE) {
+        spareSemaphores.push_back(batch.transferDone); // unsignaled again, the acquire submit waited on it
+    }
+    vkResetFences(device, 1, &batch.fence);
+    spareFences.push_back(batch.fence);
+}
+
+void UploadBatcher::collect() {
+    // batches are retired oldest first so completedTicket can stay a single number
+    size_t retired = 0;
+    while (retired < inFlight.size() && VK_SUCCESS == vkGetFenceStatus(device, inFlight[retired].fence)) {
+        completedTicket = inFlight[retired].ticket;
+        retire(inFlight[retired]);
+        retired++;
+    }
+    inFlight.erase(inFlight.begin(), inFlight.begin() + retired);
+}
+
+bool UploadBatcher::isReady(UploadTicket ticket) {
+    if (ticket <= completedTicket) {
+        return true;
+    }
+    collect();
+    return ticket <= completedTicket;
+}
+
+void UploadBatcher::wait(UploadTicket ticket) {
+    if (ticket >= open.ticket) {
+        submit();
+    }
+    for (Batch & batch : inFlight) {
+        if (batch.ticket > ticket) {
+            break;
+        }
+        if (VK_SUCCESS != vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX)) {
+            throw std::runtime_error("failed to wait for upload batch");
+        }
+    }
+    collect();
+}
+
+void UploadBatcher::destroy() {
+    if (open.commandBuffer != VK_NULL_HANDLE) {
+        submit();
+    }
+    if (!inFlight.empty()) {
+        wait(inFlight.back().ticket);
+    }
+    for (VkFence fence : spareFences) {
+        vkDestroyFence(device, fence, nullptr);
+    }
+    spareFences.clear();
+    for (VkSemaphore semaphore : spareSemaphores) {
+        vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    spareSemaphores.clear();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#include "allocator.h"
+#include "mipgenerator.h"
+
+// Identifies the batch an upload was recorded into.  Tickets grow with every batch, 0 is never handed out.
+typedef uint64_t UploadTicket;
+
+// Mapped upload memory and the buffer over it, the source of a batch's copies.
+struct StagingBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation;
+};
+
+// a queue and a command pool of its family, only used from the thread that owns the UploadBatcher
+struct UploadQueue {
+    VkQueue queue;
+    uint32_t family;
+    VkCommandPool commandPool;
+};
+
+// Records layout transitions, buffer to image copies and mip chains for many images into one command buffer,
+// which is submitted once with a fence.  Nothing here waits on the queue: callers poll isReady with the ticket
+// from uploadImage, and staging memory is handed back to the allocator once collect sees the batch's fence.
+// Later work on the same queue is ordered after the upload by its final barriers, so rendering may sample
+// an image as soon as its batch is submitted; readiness only matters to the CPU, for instance to free or reuse.
+//
+// Given a transfer queue of another family, copies run there instead of competing with rendering.  Each batch then
+// releases what it wrote from the transfer family and a second command buffer on the graphics queue acquires it,
+// waiting on a semaphore the transfer submit signals.  Mip chains are blitted by that second command buffer, since
+// transfer queues cannot blit.  The fence sits on the graphics submit, so tickets keep their meaning, and rendering
+// submitted afterwards is still ordered after the upload by the acquiring command buffer's barriers.
+//
+// With a MipGenerator, chains of images in a format it can write are built by one compute dispatch on the graphics
+// queue instead of blits; recordMipmaps remains for everything else.
+class UploadBatcher {
+    struct Batch {
+        UploadTicket ticket;
+        VkCommandBuffer commandBuffer; // on the transfer queue
+        VkCommandBuffer acquireCommandBuffer; // on the graphics queue, VK_NULL_HANDLE unless the queues differ
+        VkSemaphore transferDone; // transfer submit to acquire submit, VK_NULL_HANDLE unless the queues differ
+        VkFence fence;
+        std::vector<StagingBuffer> staging;
+        std::vector<std::function<void()>> releases; // of mip generator dispatches, run once the fence signals
+    };
+
+    GpuAllocator & allocator;
+    VkDevice device;
+    UploadQueue graphics;
+    UploadQueue transfer;
+    bool dedicatedTransfer; // the queues are of different families and need ownership transfers
+    MipGenerator * mipGenerator; // nullptr to blit every chain
+
+    Batch open; // being recorded, commandBuffer is VK_NULL_HANDLE until the first upload
+    std::vector<Batch> inFlight; // submitted, in submission order
+    std::vector<VkFence> spareFences;
+    std::vector<VkSemaphore> spareSemaphores;
+    UploadTicket completedTicket; // every batch up to and including this one is done
+
+    void beginBatch();
+    StagingBuffer & createStaging(size_t byteCount);
+    void recordImageUpload(VkBuffer staging, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format);
+    VkCommandBuffer beginCommandBuffer(VkCommandPool commandPool);
+    void retire(Batch & batch);
+
+public:
+    // pass the graphics queue as transfer too when there is no dedicated transfer queue
+    UploadBatcher(GpuAllocator & allocator, VkDevice device, UploadQueue graphics, UploadQueue transfer, MipGenerator * mipGenerator = nullptr);
+    ~UploadBatcher();
+
+    // Copy pixels into staging memory and record upload of mip 0 plus blits for the rest of the chain.
+    // The image must be in UNDEFINED layout with TRANSFER_SRC and TRANSFER_DST usage; it ends in SHADER_READ_ONLY.
+    // Pass the format the image is sampled as to let the chain be computed; the image must then have been created
+    // in mipStorageFormat(format), with MUTABLE_FORMAT and STORAGE usage, unless that is VK_FORMAT_UNDEFINED.
+    UploadTicket uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const void * pixels, size_t byteCount, VkFormat format = VK_FORMAT_UNDEFINED);
+
+    // Like uploadImage, but hands back the mapped staging memory instead of copying into it, so a decoder can write
+    // the pixels there directly.  All byteCount bytes must be written before the next submit.  The memory may be
+    // write-combined, so write it sequentially and never read it back.
+    std::tuple<UploadTicket, void*> stageImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, size_t byteCount, VkFormat format = VK_FORMAT_UNDEFINED);
+
+    // Staging memory outside any batch, for pixels decoded before the upload is recorded, such as by a decode job.
+    // Unlike the rest of the class, these two are safe from any thread.  The same write-combining rules as
+    // stageImage apply.  Hand the buffer to uploadImage, which takes it over, or give it back with freeStaging.
+    StagingBuffer allocateStaging(size_t byteCount);
+    void freeStaging(const StagingBuffer & staging);
+
+    // Like uploadImage, with the pixels already in staging from allocateStaging, which then belongs to the batch.
+    UploadTicket uploadImage(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, const StagingBuffer & staging, VkFormat format = VK_FORMAT_UNDEFINED);
+
+    // the format to create an image sampled as sampledFormat in so its chain is computed, VK_FORMAT_UNDEFINED to blit it
+    VkFormat mipStorageFormat(VkFormat sampledFormat) const;
+
+    // Copy bytes into staging memory and record their copy to the start of a device local buffer with TRANSFER_DST
+    // usage.  The final barrier makes the data visible to any later read on the queue, vertex fetch included.
+    UploadTicket uploadBuffer(VkBuffer buffer, const void * data, size_t byteCount);
+
+    // Submit everything recorded since the last submit.  Returns the ticket of the submitted batch.
+    UploadTicket submit();
+
+    // Non-blocking check whether the batch holding this ticket has finished on the GPU.
+    bool isReady(UploadTicket ticket);
+
+    // Block until the batch holding this ticket is finished, submitting it first if it is still open.
+    void wait(UploadTicket ticket);
+
+    // Release staging memory and command buffers of every finished batch.  Cheap, call once per frame.
+    void collect();
+
+    size_t pendingBatchCount() const { return inFlight.size(); }
+    bool usesTransferQueue() const { return dedicatedTransfer; }
+
+    // wait for everything and free all Vulkan objects, call before destroying the allocator
+    void destroy();
+};
+
+// record a copy of tightly packed pixels into mip 0 of an image in TRANSFER_DST_OPTIMAL layout
+void recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+
+// record blits from mip 0 down the chain, every level must start in TRANSFER_DST_OPTIMAL and ends in SHADER_READ_ONLY_OPTIMAL
+void recordMipmaps(VkCommandBuffer commandBuffer, VkImage image, int width, int height, size_t mipLevelCount);